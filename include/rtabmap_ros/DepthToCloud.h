@@ -0,0 +1,60 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEPTHTOCLOUD_H_
+#define DEPTHTOCLOUD_H_
+
+#include <sensor_msgs/PointCloud2.h>
+#include <opencv2/core/core.hpp>
+
+namespace rtabmap_ros {
+
+/**
+ * Back-project a depth image (16UC1/mono16 in mm or 32FC1 in m) directly
+ * in a PointCloud2 message, in one pass over the image: decimation, max
+ * depth clipping (0=disabled) and, if voxelSize > 0, voxel filtering (the
+ * centroid of each voxel is kept). Without voxel filtering, the cloud is
+ * organized with NaN for invalid points, otherwise it is unorganized.
+ * If "rgb" is not empty (bgr8 or mono8, same size as depth), the rgb
+ * field is added. With "parallel", the rows are split between threads.
+ */
+void depthToCloudMsg(
+		const cv::Mat & depth,
+		const cv::Mat & rgb,
+		float fx,
+		float fy,
+		float cx,
+		float cy,
+		int decimation,
+		float maxDepth,
+		float voxelSize,
+		bool parallel,
+		sensor_msgs::PointCloud2 & msg);
+
+}
+
+#endif /* DEPTHTOCLOUD_H_ */
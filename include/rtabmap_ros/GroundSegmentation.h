@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef GROUNDSEGMENTATION_H_
+#define GROUNDSEGMENTATION_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/pcl_base.h>
+#include <Eigen/Core>
+#include <boost/unordered_map.hpp>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Fit a plane with RANSAC on the points (all if "indices" is null), with
+ * a normal within groundNormalAngle of the z axis. Returned coefficients
+ * (ax+by+cz+d=0) have the normal pointing up, they are all 0 if no plane
+ * is found.
+ */
+Eigen::Vector4f fitGroundPlane(
+		const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud,
+		const pcl::IndicesPtr & indices,
+		float groundNormalAngle,
+		float distanceThreshold);
+
+/**
+ * Working buffers of segmentObstaclesFromHeightGrid(). Keep an instance
+ * between calls to avoid reallocating them for each cloud.
+ */
+struct HeightGridBuffers
+{
+	std::vector<int> points; // valid points
+	std::vector<int> pointCells; // cell of each valid point
+	boost::unordered_map<unsigned long long, int> cells; // occupied cells by coordinates
+	std::vector<int> cellX;
+	std::vector<int> cellY;
+	std::vector<float> cellMinZ;
+	std::vector<int> cellMinIndex;
+	std::vector<unsigned char> groundCells;
+	std::vector<int> cellObstacles;
+	std::vector<int> cellClusters;
+};
+
+/**
+ * Segment ground and obstacles with a 2.5D height grid, an alternative to
+ * rtabmap::util3d::segmentObstaclesFromGround() without normal estimation.
+ * The cloud should be expressed in a frame with z up (e.g. base_link).
+ * The lowest z of each cell of size "cellSize" is computed on the xy plane,
+ * only occupied cells are stored so the memory doesn't depend on the extent
+ * of the cloud.
+ * A cell can be ground if none of its neighbors is lower than
+ * cellSize*tan(groundNormalAngle)+maxGroundStep, if its lowest point is
+ * under maxGroundHeight (0=disabled) and, if "ransacPlane" is true, if its
+ * lowest point is close to the plane fitted by RANSAC on the lowest points of
+ * all cells (the height test is used alone if no plane is found). Points of
+ * ground cells under lowest z + maxGroundStep are ground, the others are
+ * obstacles, which are clustered by connected cells: clusters with less than
+ * minClusterSize points are ignored.
+ * Without RANSAC plane and maxGroundHeight (the defaults of obstacles_detection),
+ * only the local slope is checked: the flat top of an elevated surface (e.g.
+ * a table) is then labeled ground. Set maxGroundHeight and/or ransacPlane to
+ * reject them.
+ * If "indices" is null, all points of the cloud are segmented.
+ * If "groundPlane" is not null, it is set to the fitted plane (ax+by+cz+d=0),
+ * or to (0,0,0,0) if no plane has been fitted.
+ * If "referencePlane" is not null, it is used instead of the RANSAC plane.
+ * If "buffers" is not null, they are reused instead of being allocated.
+ */
+void segmentObstaclesFromHeightGrid(
+		const pcl::PointCloud<pcl::PointXYZ> & cloud,
+		const pcl::IndicesConstPtr & indices,
+		float cellSize,
+		float maxGroundStep,
+		float groundNormalAngle,
+		float maxGroundHeight,
+		bool ransacPlane,
+		int minClusterSize,
+		pcl::IndicesPtr & ground,
+		pcl::IndicesPtr & obstacles,
+		Eigen::Vector4f * groundPlane = 0,
+		const Eigen::Vector4f * referencePlane = 0,
+		HeightGridBuffers * buffers = 0);
+
+}
+
+#endif /* GROUNDSEGMENTATION_H_ */
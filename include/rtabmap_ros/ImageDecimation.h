@@ -0,0 +1,50 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef IMAGEDECIMATION_H_
+#define IMAGEDECIMATION_H_
+
+#include <opencv2/core/core.hpp>
+
+namespace rtabmap_ros {
+
+/**
+ * Decimate "image" by averaging blocks of decimation x decimation pixels,
+ * "output" should already be allocated to (image.cols/decimation,
+ * image.rows/decimation) with the type of "image" (e.g. on the data of an
+ * image message, see imageMsgBuffer()), it is filled in place.
+ * Color and mono images are area-averaged (cv::INTER_AREA).
+ * If "depth" is true (16UC1 in mm or 32FC1 in m), only valid pixels (not 0
+ * nor NaN) of a block are averaged, blocks without valid pixel are 0.
+ * Output rows are split between threads.
+ */
+void decimateImage(const cv::Mat & image, int decimation, bool depth, cv::Mat & output);
+
+}
+
+#endif /* IMAGEDECIMATION_H_ */
@@ -31,6 +31,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <tf/tf.h>
 #include <geometry_msgs/Transform.h>
 #include <geometry_msgs/Pose.h>
+#include <sensor_msgs/Image.h>
+
+#include <cv_bridge/cv_bridge.h>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/features2d/features2d.hpp>
@@ -111,6 +114,26 @@ void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData &
 rtabmap::OdometryInfo odomInfoFromROS(const rtabmap_ros::OdomInfo & msg);
 void odomInfoToROS(const rtabmap::OdometryInfo & info, rtabmap_ros::OdomInfo & msg);
 
+// Same as cv_bridge::toCvShare(), but the last conversions (to another
+// encoding) are cached for the process: when nodelets of the same manager
+// receive the same image message, it is converted only once. Entries are
+// matched on the message pointer, its header and its data, so messages
+// reused by imageMsgBuffer() are converted again. A mono8 conversion is
+// derived from the bgr8 conversion of the same message if already cached.
+cv_bridge::CvImageConstPtr toCvShareCached(const sensor_msgs::ImageConstPtr & msg, const std::string & encoding = std::string());
+
+// Set "msg" as an image of this size/type/encoding and return a cv::Mat
+// on its data, to be filled in place. The previous message is reused if
+// nobody else references it anymore (e.g. an intra-process subscriber),
+// otherwise a new one is allocated.
+cv::Mat imageMsgBuffer(
+		sensor_msgs::ImagePtr & msg,
+		const std_msgs::Header & header,
+		int rows,
+		int cols,
+		int type,
+		const std::string & encoding);
+
 inline double timestampFromROS(const ros::Time & stamp) {return double(stamp.sec) + double(stamp.nsec)/1000000000.0;}
 
 }
@@ -0,0 +1,201 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ODOMETRYROS_H_
+#define ODOMETRYROS_H_
+
+#include <ros/ros.h>
+#include <nodelet/nodelet.h>
+
+#include <tf2_ros/transform_broadcaster.h>
+#include <tf/transform_listener.h>
+
+#include <std_srvs/Empty.h>
+#include <std_msgs/Header.h>
+
+#include <rtabmap_ros/ResetPose.h>
+#include <rtabmap/core/SensorData.h>
+#include <rtabmap/core/Parameters.h>
+
+#include <pcl/point_types.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <deque>
+
+namespace rtabmap {
+class Odometry;
+}
+
+namespace rtabmap_ros {
+
+class OdometryROS : public nodelet::Nodelet
+{
+public:
+	OdometryROS();
+	virtual ~OdometryROS();
+
+	// Show odometry parameters and exit if "--params" is found
+	static void processArguments(int argc, char * argv[]);
+	// "timeSynchronized" is when the subscriber callback started, to get
+	// the conversion time in the statistics (ignored if zero)
+	void processData(
+			const rtabmap::SensorData & data,
+			const ros::Time & stamp,
+			const ros::WallTime & timeSynchronized = ros::WallTime());
+
+	bool reset(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
+	bool resetToPose(rtabmap_ros::ResetPose::Request&, rtabmap_ros::ResetPose::Response&);
+	bool pause(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
+	bool resume(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
+
+	const std::string & frameId() const {return frameId_;}
+	const std::string & odomFrameId() const {return odomFrameId_;}
+	const rtabmap::ParametersMap & parameters() const {return parameters_;}
+	const tf::TransformListener & tfListener() const {return tfListener_;}
+	bool isPaused() const {return paused_;}
+	bool isOdometryBOW() const;
+	bool waitForTransform() const {return waitForTransform_;}
+
+	// Transform from frameId() to the sensor frame (null on failure). When
+	// "static_local_transform" is true, a transform looked up identical a
+	// few times in a row is cached and returned without waiting on TF.
+	rtabmap::Transform getLocalTransform(const std::string & sensorFrameId, const ros::Time & stamp);
+
+protected:
+	// Subscribe the inputs, called at the end of onInit()
+	virtual void onOdomInit() = 0;
+
+	// Register on an input subscriber to count the received frames
+	template<class M>
+	void countReceived(const boost::shared_ptr<M const> &)
+	{
+		boost::mutex::scoped_lock lock(statisticsMutex_);
+		++statsReceived_;
+	}
+
+private:
+	virtual void onInit();
+	bool skipFrame(const rtabmap::SensorData & data);
+	void resetSkipping();
+	void softReset(const rtabmap::Transform & pose);
+	void publishOdom(const rtabmap::Transform & pose, const ros::Time & stamp, float variance);
+	void estimateMotion(const rtabmap::SensorData & data, const ros::Time & stamp, double timePipeline);
+	void pipelineLoop();
+	void localTransformsTimerCallback(const ros::TimerEvent &);
+	void statisticsTimerCallback(const ros::WallTimerEvent &);
+
+private:
+	rtabmap::Odometry * odometry_;
+	boost::mutex odometryMutex_;
+	rtabmap::SensorData lastData_; // last frame processed, to seed odometry on reset
+
+	// parameters
+	std::string frameId_;
+	std::string odomFrameId_;
+	std::string groundTruthFrameId_;
+	bool publishTf_;
+	bool waitForTransform_;
+	bool pipelined_;
+	bool staticLocalTransform_;
+	int localMapDeltaDecimation_;
+	double statisticsPeriod_;
+	double skipThreshold_;
+	int skipMaxFrames_;
+	bool resetSeed_;
+	rtabmap::ParametersMap parameters_;
+
+	ros::Publisher odomPub_;
+	ros::Publisher odomInfoPub_;
+	ros::Publisher odomLocalMap_;
+	ros::Publisher odomLocalMapDelta_;
+	ros::Publisher odomLastFrame_;
+	ros::Publisher odomStatisticsPub_;
+	ros::ServiceServer resetSrv_;
+	ros::ServiceServer resetToPoseSrv_;
+	ros::ServiceServer pauseSrv_;
+	ros::ServiceServer resumeSrv_;
+	tf2_ros::TransformBroadcaster tfBroadcaster_;
+	tf::TransformListener tfListener_;
+
+	bool paused_;
+
+	// last local maps (OdometryBOW) published on odom_local_map (to publish
+	// only when it changes) and on odom_local_map_delta (to get new points)
+	std::map<int, pcl::PointXYZ> localMap_;
+	std::map<int, pcl::PointXYZ> localMapDelta_;
+
+	// static local transforms: cached ones are refreshed
+	// by localTransformsTimer_ without blocking on TF
+	boost::mutex localTransformsMutex_;
+	std::map<std::string, rtabmap::Transform> localTransforms_;
+	std::map<std::string, std::pair<rtabmap::Transform, int> > localTransformsPending_;
+	ros::Timer localTransformsTimer_;
+
+	// frame skipping: thumbnail of the last processed
+	// frame and last pose, republished for skipped frames
+	cv::Mat skipThumbnail_;
+	int skipCount_;
+	boost::mutex lastPoseMutex_;
+	rtabmap::Transform lastPose_;
+	float lastVariance_;
+
+	// statistics: windows of the last times (s) of each
+	// stage and counters since the last published message
+	ros::WallTimer statisticsTimer_;
+	boost::mutex statisticsMutex_;
+	std::deque<float> statsLatency_;
+	std::deque<float> statsTimeConversion_;
+	std::deque<float> statsTimePipeline_;
+	std::deque<float> statsTimeEstimation_;
+	std::deque<float> statsTimePublish_;
+	int statsReceived_;
+	int statsConverted_;
+	int statsDroppedPipeline_;
+	int statsSkipped_;
+	int statsProcessed_;
+	int statsLost_;
+	ros::WallTime statsLastTime_;
+
+	// pipelined mode: the subscriber callbacks convert the
+	// data, the motion is estimated in pipelineThread_
+	boost::thread * pipelineThread_;
+	boost::mutex pipelineMutex_;
+	boost::condition_variable pipelineCondition_;
+	bool pipelineStop_;
+	bool pipelineHasData_;
+	rtabmap::SensorData pipelineData_;
+	ros::Time pipelineStamp_;
+	ros::WallTime pipelineTime_;
+	int pipelineDropped_;
+};
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef POSESGRIDINDEX_H_
+#define POSESGRIDINDEX_H_
+
+#include <rtabmap/core/Transform.h>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Spatial hash of node poses, updated incrementally as the graph changes.
+ * The cell size should be about the radius of the queries (e.g., the node
+ * filtering radius) so that a radius search only visits the neighbor cells.
+ * The result of radiusPosesFiltering() is kept and returned as is
+ * while the poses and the filtering parameters don't change.
+ */
+class PosesGridIndex
+{
+public:
+	PosesGridIndex(float cellSize = 1.0f);
+
+	void clear();
+	void setCellSize(float cellSize);
+	float cellSize() const {return cellSize_;}
+
+	// Add new poses, move the ones that changed and remove those not in "poses",
+	// in a single pass over both maps. Return true if the index has been modified.
+	bool update(const std::map<int, rtabmap::Transform> & poses);
+	// Add or move a single pose.
+	bool update(int id, const rtabmap::Transform & pose);
+	bool remove(int id);
+
+	const std::map<int, rtabmap::Transform> & poses() const {return poses_;}
+
+	// Same result than rtabmap::graph::radiusPosesFiltering(poses(), radius, angle),
+	// the cell size is adjusted to radius if not already set to it.
+	const std::map<int, rtabmap::Transform> & radiusPosesFiltering(float radius, float angle);
+
+	// Ids (ascending) of the nodes in the radius of "center"
+	std::vector<int> radiusSearch(const rtabmap::Transform & center, float radius) const;
+	// Ids (ascending) of the nodes inside the axis-aligned box
+	std::vector<int> boxSearch(
+			float minX, float minY, float minZ,
+			float maxX, float maxY, float maxZ) const;
+
+private:
+	struct Cell
+	{
+		Cell(int x=0, int y=0, int z=0) : x(x), y(y), z(z) {}
+		bool operator<(const Cell & c) const
+		{
+			return x<c.x || (x==c.x && (y<c.y || (y==c.y && z<c.z)));
+		}
+		bool operator==(const Cell & c) const {return x==c.x && y==c.y && z==c.z;}
+		int x, y, z;
+	};
+
+	Cell cellOf(float x, float y, float z) const;
+	void insertInGrid(int id, const rtabmap::Transform & pose);
+	void removeFromGrid(int id);
+	void searchCells(
+			float minX, float minY, float minZ,
+			float maxX, float maxY, float maxZ,
+			std::vector<int> & ids) const;
+
+private:
+	float cellSize_;
+	std::map<int, rtabmap::Transform> poses_;
+	std::map<int, Cell> nodeCells_;
+	std::map<Cell, std::set<int> > grid_;
+
+	// cached filtering result
+	bool filteredValid_;
+	float filteredRadius_;
+	float filteredAngle_;
+	std::map<int, rtabmap::Transform> filteredPoses_;
+};
+
+}
+
+#endif /* POSESGRIDINDEX_H_ */
@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef STAMPTHROTTLE_H_
+#define STAMPTHROTTLE_H_
+
+#include <ros/time.h>
+#include <rtabmap/core/Transform.h>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+
+namespace rtabmap_ros {
+
+/**
+ * Select frames to throttle only from their header stamps, so that the same
+ * frames are selected whatever the callback scheduling, in bag playback or
+ * in simulation. Selection is phase-locked on multiples of the period: for
+ * each boundary, the frame the closest to it is selected (a frame is
+ * selected if the next one, expected one input interval later, would be
+ * farther from the boundary), so no frame has to be delayed.
+ * With keyframe motion thresholds, a frame is selected only if the
+ * odometry pose at its stamp moved more than the thresholds since the last
+ * selected frame (the rate is then a maximum rate). Until odometry is
+ * received, only the first frame is selected; afterwards frames without
+ * odometry at their stamp (within 0.5 s) are not selected.
+ */
+class StampThrottle
+{
+public:
+	StampThrottle();
+
+	void setRate(double rate); // Hz, 0 = all frames
+	void setKeyframeMotion(float linear, float angular); // m, rad, 0 = disabled
+	bool isKeyframeMotionEnabled() const {return linear_ > 0.0f || angular_ > 0.0f;}
+
+	// odometry poses, the closest one to a frame's stamp is used
+	void addOdom(const ros::Time & stamp, const rtabmap::Transform & pose);
+
+	// true if the frame with this stamp should be published
+	bool select(const ros::Time & stamp);
+
+private:
+	void reset();
+	rtabmap::Transform poseAt(double stamp) const;
+
+private:
+	double period_;
+	float linear_;
+	float angular_;
+
+	double lastStamp_;
+	double frameInterval_; // between the last two input frames
+	long long nextBoundary_; // index of the next period boundary, -1 if not set
+	rtabmap::Transform lastSelectedPose_;
+	std::deque<std::pair<double, rtabmap::Transform> > odoms_; // last 2 s
+	bool firstSelected_;
+	boost::mutex mutex_;
+};
+
+}
+
+#endif /* STAMPTHROTTLE_H_ */
@@ -70,7 +70,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace rtabmap;
 
-CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
+CoreWrapper::CoreWrapper(
+		bool deleteDbOnStart,
+		const ros::NodeHandle & nh,
+		const ros::NodeHandle & pnh) :
+		nh_(nh),
+		pnh_(pnh),
 		paused_(false),
 		lastPose_(Transform::getIdentity()),
 		rotVariance_(0),
@@ -86,6 +91,7 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 		genScan_(false),
 		genScanMaxDepth_(4.0),
 		mapToOdom_(rtabmap::Transform::getIdentity()),
+		mapsManager_(nh, pnh),
 		depthSync_(0),
 		depthScanSync_(0),
 		stereoScanSync_(0),
@@ -98,12 +104,13 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 		stereoApproxTFSync_(0),
 		stereoExactTFSync_(0),
 		transformThread_(0),
+		transformThreadCanceled_(false),
 		rate_(Parameters::defaultRtabmapDetectionRate()),
 		time_(ros::Time::now()),
-		mbClient_("move_base", true)
+		mbClient_(nh, "move_base", true)
 {
-	ros::NodeHandle nh;
-	ros::NodeHandle pnh("~");
+	ros::NodeHandle & nh = nh_;
+	ros::NodeHandle & pnh = pnh_;
 
 	bool subscribeLaserScan = false;
 	bool subscribeDepth = true;
@@ -386,6 +393,15 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 		ROS_INFO("rtabmap: Database version = \"%s\".", rtabmap_.getMemory()->getDatabaseVersion().c_str());
 	}
 
+	if(mapsManager_.isWarmUpEnabled())
+	{
+		// prefill the map caches of the local map in background
+		std::map<int, Transform> poses;
+		std::multimap<int, Link> constraints;
+		rtabmap_.getGraph(poses, constraints, true, false);
+		mapsManager_.startWarmUp(poses, rtabmap_.getMemory());
+	}
+
 	// setup services
 	updateSrv_ = nh.advertiseService("update_parameters", &CoreWrapper::updateRtabmapCallback, this);
 	resetSrv_ = nh.advertiseService("reset", &CoreWrapper::resetRtabmapCallback, this);
@@ -398,7 +414,9 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 	getMapDataSrv_ = nh.advertiseService("get_map", &CoreWrapper::getMapCallback, this);
 	getGridMapSrv_ = nh.advertiseService("get_grid_map", &CoreWrapper::getGridMapCallback, this);
 	getProjMapSrv_ = nh.advertiseService("get_proj_map", &CoreWrapper::getProjMapCallback, this);
+	getMapRegionSrv_ = nh.advertiseService("get_map_region", &CoreWrapper::getMapRegionCallback, this);
 	publishMapDataSrv_ = nh.advertiseService("publish_map", &CoreWrapper::publishMapCallback, this);
+	exportMapSrv_ = nh.advertiseService("export_map", &CoreWrapper::exportMapCallback, this);
 	setGoalSrv_ = nh.advertiseService("set_goal", &CoreWrapper::setGoalCallback, this);
 	cancelGoalSrv_ = nh.advertiseService("cancel_goal", &CoreWrapper::cancelGoalCallback, this);
 	setLabelSrv_ = nh.advertiseService("set_label", &CoreWrapper::setLabelCallback, this);
@@ -427,6 +445,10 @@ CoreWrapper::~CoreWrapper()
 {
 	if(transformThread_)
 	{
+		{
+			boost::mutex::scoped_lock lock(transformThreadMutex_);
+			transformThreadCanceled_ = true;
+		}
 		transformThread_->join();
 		delete transformThread_;
 	}
@@ -472,13 +494,12 @@ CoreWrapper::~CoreWrapper()
 
 	this->saveParameters(configPath_);
 
-	ros::NodeHandle nh;
 	ParametersMap parameters = Parameters::getDefaultParameters();
 	for(ParametersMap::iterator iter=parameters.begin(); iter!=parameters.end(); ++iter)
 	{
-		nh.deleteParam(iter->first);
+		nh_.deleteParam(iter->first);
 	}
-	nh.deleteParam("is_rtabmap_paused");
+	nh_.deleteParam("is_rtabmap_paused");
 
 	printf("rtabmap: Saving database/long-term memory... (located at %s)\n", databasePath_.c_str());
 }
@@ -512,11 +533,10 @@ void CoreWrapper::saveParameters(const std::string & configFile)
 		}
 
 		ParametersMap parameters = Parameters::getDefaultParameters();
-		ros::NodeHandle nh;
 		for(ParametersMap::iterator iter=parameters.begin(); iter!=parameters.end(); ++iter)
 		{
 			std::string value;
-			if(nh.getParam(iter->first,value))
+			if(nh_.getParam(iter->first,value))
 			{
 				iter->second = value;
 			}
@@ -535,7 +555,7 @@ void CoreWrapper::publishLoop(double tfDelay)
 	if(tfDelay == 0)
 		return;
 	ros::Rate r(1.0 / tfDelay);
-	while(ros::ok())
+	while(ros::ok() && !isTransformThreadCanceled())
 	{
 		if(!odomFrameId_.empty())
 		{
@@ -553,6 +573,12 @@ void CoreWrapper::publishLoop(double tfDelay)
 	}
 }
 
+bool CoreWrapper::isTransformThreadCanceled()
+{
+	boost::mutex::scoped_lock lock(transformThreadMutex_);
+	return transformThreadCanceled_;
+}
+
 void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 {
 	if(!paused_)
@@ -579,11 +605,11 @@ void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 		if(imageMsg->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 		   imageMsg->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
 		{
-			ptrImage = cv_bridge::toCvShare(imageMsg, "mono8");
+			ptrImage = rtabmap_ros::toCvShareCached(imageMsg, "mono8");
 		}
 		else
 		{
-			ptrImage = cv_bridge::toCvShare(imageMsg, "bgr8");
+			ptrImage = rtabmap_ros::toCvShareCached(imageMsg, "bgr8");
 		}
 
 		// process data
@@ -819,11 +845,11 @@ void CoreWrapper::commonDepthCallback(
 		else if(imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 		   imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
 		{
-			ptrImage = cv_bridge::toCvShare(imageMsgs[i], "mono8");
+			ptrImage = rtabmap_ros::toCvShareCached(imageMsgs[i], "mono8");
 		}
 		else
 		{
-			ptrImage = cv_bridge::toCvShare(imageMsgs[i], "bgr8");
+			ptrImage = rtabmap_ros::toCvShareCached(imageMsgs[i], "bgr8");
 		}
 		cv_bridge::CvImageConstPtr ptrDepth = cv_bridge::toCvShare(depthMsgs[i]);
 		cv::Mat subDepth = ptrDepth->image;
@@ -1049,13 +1075,13 @@ void CoreWrapper::commonStereoCallback(
 	if(leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 	   leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
 	{
-		ptrLeftImage = cv_bridge::toCvShare(leftImageMsg, "mono8");
+		ptrLeftImage = rtabmap_ros::toCvShareCached(leftImageMsg, "mono8");
 	}
 	else
 	{
-		ptrLeftImage = cv_bridge::toCvShare(leftImageMsg, "bgr8");
+		ptrLeftImage = rtabmap_ros::toCvShareCached(leftImageMsg, "bgr8");
 	}
-	ptrRightImage = cv_bridge::toCvShare(rightImageMsg, "mono8");
+	ptrRightImage = rtabmap_ros::toCvShareCached(rightImageMsg, "mono8");
 
 	image_geometry::StereoCameraModel model;
 	model.fromCameraInfo(*leftCamInfoMsg, *rightCamInfoMsg);
@@ -1429,7 +1455,7 @@ void CoreWrapper::goalCallback(const geometry_msgs::PoseStampedConstPtr & msg)
 bool CoreWrapper::updateRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
 	rtabmap::ParametersMap parameters = rtabmap::Parameters::getDefaultParameters();
-	ros::NodeHandle nh;
+	ros::NodeHandle & nh = nh_;
 	for(rtabmap::ParametersMap::iterator iter=parameters.begin(); iter!=parameters.end(); ++iter)
 	{
 		std::string vStr;
@@ -1490,8 +1516,7 @@ bool CoreWrapper::pauseRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empt
 	{
 		paused_ = true;
 		ROS_INFO("rtabmap: paused!");
-		ros::NodeHandle nh;
-		nh.setParam("is_rtabmap_paused", true);
+		nh_.setParam("is_rtabmap_paused", true);
 	}
 	return true;
 }
@@ -1506,8 +1531,7 @@ bool CoreWrapper::resumeRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 	{
 		paused_ = false;
 		ROS_INFO("rtabmap: resumed!");
-		ros::NodeHandle nh;
-		nh.setParam("is_rtabmap_paused", false);
+		nh_.setParam("is_rtabmap_paused", false);
 	}
 	return true;
 }
@@ -1521,6 +1545,14 @@ bool CoreWrapper::triggerNewMapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 
 bool CoreWrapper::backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	// the export and the warm-up load their nodes from the memory, which is deleted here
+	if(mapsManager_.isExporting())
+	{
+		ROS_WARN("Backup: the running export is canceled.");
+	}
+	mapsManager_.stopExport();
+	mapsManager_.stopWarmUp();
+
 	ROS_INFO("Backup: Saving memory...");
 	rtabmap_.close();
 	ROS_INFO("Backup: Saving memory... done!");
@@ -1688,6 +1720,98 @@ bool CoreWrapper::getGridMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::
 	return false;
 }
 
+bool CoreWrapper::exportMapCallback(rtabmap_ros::ExportMap::Request& req, rtabmap_ros::ExportMap::Response& res)
+{
+	ROS_INFO("rtabmap: Exporting map to \"%s\" (global=%s)...", req.path.c_str(), req.global?"true":"false");
+
+	std::map<int, Transform> poses;
+	std::multimap<int, Link> constraints;
+	rtabmap_.getGraph(
+			poses,
+			constraints,
+			true,
+			req.global);
+
+	std::map<int, Transform> filteredPoses = mapsManager_.getFilteredPoses(poses);
+	if(filteredPoses.empty())
+	{
+		// no filtering
+		filteredPoses = poses;
+	}
+
+	res.nodes = mapsManager_.startExport(req.path, filteredPoses, rtabmap_.getMemory(), req.voxelSize);
+	return res.nodes >= 0;
+}
+
+bool CoreWrapper::getMapRegionCallback(rtabmap_ros::GetMapRegion::Request& req, rtabmap_ros::GetMapRegion::Response& res)
+{
+	Transform center = rtabmap_ros::transformFromPoseMsg(req.center);
+	if(center.isNull() || (req.radius <= 0.0f && (req.boxHalfSize.x <= 0.0 || req.boxHalfSize.y <= 0.0 || req.boxHalfSize.z <= 0.0)))
+	{
+		ROS_ERROR("rtabmap: get_map_region: center should be valid and radius or box half size should be > 0");
+		return false;
+	}
+
+	std::map<int, rtabmap::Transform> regionPoses;
+	regionPoses = mapsManager_.updateRegionMapCaches(
+			rtabmap_.getLocalOptimizedPoses(),
+			rtabmap_.getMemory(),
+			center,
+			req.radius,
+			cv::Point3f(req.boxHalfSize.x, req.boxHalfSize.y, req.boxHalfSize.z),
+			req.cloud,
+			req.proj,
+			req.grid);
+
+	res.nodeIds = uKeys(regionPoses);
+	ros::Time now = ros::Time::now();
+
+	if(req.cloud && regionPoses.size())
+	{
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = mapsManager_.assembleCloudMap(regionPoses);
+		pcl::toROSMsg(*cloud, res.cloud);
+		res.cloud.header.stamp = now;
+		res.cloud.header.frame_id = mapFrameId_;
+	}
+
+	// The unknown space of the grid is filled around the current
+	// pose of the robot, not around the highest id of the region
+	Transform currentPose;
+	if(req.grid && rtabmap_.getLocalOptimizedPoses().size())
+	{
+		currentPose = rtabmap_.getLocalOptimizedPoses().rbegin()->second;
+	}
+
+	for(int i=0; i<2; ++i)
+	{
+		if((i==0?req.proj:req.grid) && regionPoses.size())
+		{
+			float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
+			cv::Mat pixels = i==0?
+					mapsManager_.generateProjMap(regionPoses, xMin, yMin, gridCellSize):
+					mapsManager_.generateGridMap(regionPoses, xMin, yMin, gridCellSize, currentPose);
+			if(!pixels.empty())
+			{
+				nav_msgs::OccupancyGrid & map = i==0?res.proj:res.grid;
+				map.info.resolution = gridCellSize;
+				map.info.origin.position.x = xMin;
+				map.info.origin.position.y = yMin;
+				map.info.origin.position.z = 0.0;
+				map.info.origin.orientation.w = 1.0;
+				map.info.width = pixels.cols;
+				map.info.height = pixels.rows;
+				map.data.resize(map.info.width * map.info.height);
+				memcpy(map.data.data(), pixels.data, map.info.width * map.info.height);
+				map.header.frame_id = mapFrameId_;
+				map.header.stamp = now;
+			}
+		}
+	}
+
+	ROS_INFO("rtabmap: Map region: %d nodes", (int)regionPoses.size());
+	return true;
+}
+
 bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtabmap_ros::PublishMap::Response& res)
 {
 	ROS_INFO("rtabmap: Publishing map...");
@@ -2232,8 +2356,8 @@ void CoreWrapper::setupCallbacks(
 		bool stereoApproxSync,
 		int depthCameras)
 {
-	ros::NodeHandle nh; // public
-	ros::NodeHandle pnh("~"); // private
+	ros::NodeHandle & nh = nh_; // public
+	ros::NodeHandle & pnh = pnh_; // private
 
 	if(subscribeDepth)
 	{
@@ -48,7 +48,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/Parameters.h>
 #include <rtabmap/core/Rtabmap.h>
 
+#include "rtabmap_ros/ExportMap.h"
 #include "rtabmap_ros/GetMap.h"
+#include "rtabmap_ros/GetMapRegion.h"
 #include "rtabmap_ros/ListLabels.h"
 #include "rtabmap_ros/PublishMap.h"
 #include "rtabmap_ros/SetGoal.h"
@@ -79,7 +81,10 @@ typedef actionlib::SimpleActionClient<move_base_msgs::MoveBaseAction> MoveBaseCl
 class CoreWrapper
 {
 public:
-	CoreWrapper(bool deleteDbOnStart);
+	CoreWrapper(
+			bool deleteDbOnStart,
+			const ros::NodeHandle & nh = ros::NodeHandle(),
+			const ros::NodeHandle & pnh = ros::NodeHandle("~"));
 	virtual ~CoreWrapper();
 
 private:
@@ -195,7 +200,9 @@ private:
 	bool getMapCallback(rtabmap_ros::GetMap::Request& req, rtabmap_ros::GetMap::Response& res);
 	bool getProjMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res);
 	bool getGridMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res);
+	bool getMapRegionCallback(rtabmap_ros::GetMapRegion::Request& req, rtabmap_ros::GetMapRegion::Response& res);
 	bool publishMapCallback(rtabmap_ros::PublishMap::Request&, rtabmap_ros::PublishMap::Response&);
+	bool exportMapCallback(rtabmap_ros::ExportMap::Request& req, rtabmap_ros::ExportMap::Response& res);
 	bool setGoalCallback(rtabmap_ros::SetGoal::Request& req, rtabmap_ros::SetGoal::Response& res);
 	bool cancelGoalCallback(std_srvs::Empty::Request& req, std_srvs::Empty::Response& res);
 	bool setLabelCallback(rtabmap_ros::SetLabel::Request& req, rtabmap_ros::SetLabel::Response& res);
@@ -209,6 +216,7 @@ private:
 	void saveParameters(const std::string & configFile);
 
 	void publishLoop(double tfDelay);
+	bool isTransformThreadCanceled();
 
 	void publishStats(const ros::Time & stamp);
 	void publishCurrentGoal(const ros::Time & stamp);
@@ -218,6 +226,9 @@ private:
 	void publishLocalPath(const ros::Time & stamp);
 
 private:
+	ros::NodeHandle nh_; // public
+	ros::NodeHandle pnh_; // private
+
 	rtabmap::Rtabmap rtabmap_;
 	bool paused_;
 	rtabmap::Transform lastPose_;
@@ -371,7 +382,9 @@ private:
 	ros::ServiceServer getMapDataSrv_;
 	ros::ServiceServer getProjMapSrv_;
 	ros::ServiceServer getGridMapSrv_;
+	ros::ServiceServer getMapRegionSrv_;
 	ros::ServiceServer publishMapDataSrv_;
+	ros::ServiceServer exportMapSrv_;
 	ros::ServiceServer setGoalSrv_;
 	ros::ServiceServer cancelGoalSrv_;
 	ros::ServiceServer setLabelSrv_;
@@ -384,6 +397,8 @@ private:
 	MoveBaseClient mbClient_;
 
 	boost::thread* transformThread_;
+	bool transformThreadCanceled_;
+	boost::mutex transformThreadMutex_; // transformThreadCanceled_ is set from another thread
 
 	float rate_;
 	ros::Time time_;
@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "CoreWrapper.h"
+#include "pluginlib/class_list_macros.h"
+#include "nodelet/nodelet.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/core/Version.h>
+
+namespace rtabmap_ros
+{
+
+class CoreWrapperNodelet : public nodelet::Nodelet
+{
+public:
+	CoreWrapperNodelet() :
+		rtabmap_(0)
+	{}
+
+	virtual ~CoreWrapperNodelet()
+	{
+		if(rtabmap_)
+		{
+			delete rtabmap_;
+		}
+	}
+
+private:
+	virtual void onInit()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+		bool deleteDbOnStart = false;
+		pnh.param("delete_db_on_start", deleteDbOnStart, deleteDbOnStart);
+
+		const std::vector<std::string> & argv = getMyArgv();
+		for(unsigned int i=0; i<argv.size(); ++i)
+		{
+			if(argv[i].compare("--delete_db_on_start") == 0)
+			{
+				deleteDbOnStart = true;
+			}
+			else if(argv[i].compare("--udebug") == 0)
+			{
+				ULogger::setLevel(ULogger::kDebug);
+			}
+			else if(argv[i].compare("--uinfo") == 0)
+			{
+				ULogger::setLevel(ULogger::kInfo);
+			}
+			else
+			{
+				NODELET_WARN("Not recognized argument \"%s\"", argv[i].c_str());
+			}
+		}
+
+		// callbacks, timers and services of the core are
+		// processed by the (single-threaded) queue of the nodelet
+		rtabmap_ = new CoreWrapper(deleteDbOnStart, nh, pnh);
+
+		NODELET_INFO("rtabmap %s started...", RTABMAP_VERSION);
+	}
+
+private:
+	CoreWrapper * rtabmap_;
+};
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::CoreWrapperNodelet, nodelet::Nodelet);
+}
@@ -0,0 +1,305 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/DepthToCloud.h"
+
+#include <sensor_msgs/point_cloud2_iterator.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <limits>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+struct Voxel
+{
+	Voxel() : x(0), y(0), z(0), r(0), g(0), b(0), n(0) {}
+	float x, y, z;
+	float r, g, b;
+	int n;
+};
+typedef boost::unordered_map<unsigned long long, Voxel> VoxelMap;
+
+// Rows of the decimated image, the x factors (u-cx)/fx are precomputed
+// per column so that the inner loops are simple multiplications.
+class DepthToCloudBody : public cv::ParallelLoopBody
+{
+public:
+	DepthToCloudBody(
+			const cv::Mat & depth,
+			const cv::Mat & rgb,
+			const std::vector<float> & xFactors,
+			float fy,
+			float cy,
+			int decimation,
+			float maxDepth,
+			float voxelSize,
+			sensor_msgs::PointCloud2 & msg,
+			VoxelMap & voxels,
+			boost::mutex & voxelsMutex) :
+		depth_(depth),
+		rgb_(rgb),
+		xFactors_(xFactors),
+		fy_(fy),
+		cy_(cy),
+		decimation_(decimation),
+		maxDepth_(maxDepth),
+		voxelSize_(voxelSize),
+		msg_(msg),
+		voxels_(voxels),
+		voxelsMutex_(voxelsMutex)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		const float bad = std::numeric_limits<float>::quiet_NaN();
+		const int width = (int)xFactors_.size();
+		const bool isDepthMM = depth_.type() == CV_16UC1;
+		const bool hasColor = !rgb_.empty();
+		const bool isMono = hasColor && rgb_.channels() == 1;
+		const float maxDepth = maxDepth_>0.0f?maxDepth_:std::numeric_limits<float>::max();
+
+		std::vector<float> z(width);
+		VoxelMap voxels;
+		for(int i=range.start; i<range.end; ++i)
+		{
+			int v = i*decimation_;
+			float yFactor = (float(v) - cy_) / fy_;
+
+			// depth of the row, invalid values to 0
+			if(isDepthMM)
+			{
+				const unsigned short * row = depth_.ptr<unsigned short>(v);
+				for(int j=0; j<width; ++j)
+				{
+					float d = float(row[j*decimation_])*0.001f;
+					z[j] = d<=maxDepth?d:0.0f;
+				}
+			}
+			else
+			{
+				const float * row = depth_.ptr<float>(v);
+				for(int j=0; j<width; ++j)
+				{
+					float d = row[j*decimation_];
+					z[j] = d>0.0f && d<=maxDepth?d:0.0f; // false with NaN
+				}
+			}
+			const unsigned char * rgbRow = hasColor?rgb_.ptr<unsigned char>(v):0;
+
+			if(voxelSize_ > 0.0f)
+			{
+				for(int j=0; j<width; ++j)
+				{
+					if(z[j] > 0.0f)
+					{
+						float x = xFactors_[j]*z[j];
+						float y = yFactor*z[j];
+						unsigned long long key =
+								((unsigned long long)((int)std::floor(x/voxelSize_) + (1<<20)) & 0x1FFFFF) << 42 |
+								((unsigned long long)((int)std::floor(y/voxelSize_) + (1<<20)) & 0x1FFFFF) << 21 |
+								((unsigned long long)((int)std::floor(z[j]/voxelSize_) + (1<<20)) & 0x1FFFFF);
+						Voxel & voxel = voxels[key];
+						voxel.x += x;
+						voxel.y += y;
+						voxel.z += z[j];
+						if(hasColor)
+						{
+							int u = j*decimation_;
+							if(isMono)
+							{
+								voxel.r += rgbRow[u];
+								voxel.g += rgbRow[u];
+								voxel.b += rgbRow[u];
+							}
+							else
+							{
+								voxel.b += rgbRow[u*3];
+								voxel.g += rgbRow[u*3+1];
+								voxel.r += rgbRow[u*3+2];
+							}
+						}
+						++voxel.n;
+					}
+				}
+			}
+			else
+			{
+				// organized: write directly in the message
+				unsigned char * out = &msg_.data[i*msg_.row_step];
+				for(int j=0; j<width; ++j, out+=msg_.point_step)
+				{
+					float * xyz = (float*)out;
+					if(z[j] > 0.0f)
+					{
+						xyz[0] = xFactors_[j]*z[j];
+						xyz[1] = yFactor*z[j];
+						xyz[2] = z[j];
+					}
+					else
+					{
+						xyz[0] = xyz[1] = xyz[2] = bad;
+					}
+					if(hasColor)
+					{
+						int u = j*decimation_;
+						// rgb field is after xyz and padding (offset 16)
+						unsigned char * bgr = out + 16;
+						if(isMono)
+						{
+							bgr[0] = bgr[1] = bgr[2] = rgbRow[u];
+						}
+						else
+						{
+							bgr[0] = rgbRow[u*3];
+							bgr[1] = rgbRow[u*3+1];
+							bgr[2] = rgbRow[u*3+2];
+						}
+						bgr[3] = 255;
+					}
+				}
+			}
+		}
+
+		if(voxels.size())
+		{
+			boost::mutex::scoped_lock lock(voxelsMutex_);
+			for(VoxelMap::iterator iter=voxels.begin(); iter!=voxels.end(); ++iter)
+			{
+				Voxel & voxel = voxels_[iter->first];
+				voxel.x += iter->second.x;
+				voxel.y += iter->second.y;
+				voxel.z += iter->second.z;
+				voxel.r += iter->second.r;
+				voxel.g += iter->second.g;
+				voxel.b += iter->second.b;
+				voxel.n += iter->second.n;
+			}
+		}
+	}
+
+private:
+	const cv::Mat & depth_;
+	const cv::Mat & rgb_;
+	const std::vector<float> & xFactors_;
+	float fy_;
+	float cy_;
+	int decimation_;
+	float maxDepth_;
+	float voxelSize_;
+	sensor_msgs::PointCloud2 & msg_;
+	VoxelMap & voxels_;
+	boost::mutex & voxelsMutex_;
+};
+
+void depthToCloudMsg(
+		const cv::Mat & depth,
+		const cv::Mat & rgb,
+		float fx,
+		float fy,
+		float cx,
+		float cy,
+		int decimation,
+		float maxDepth,
+		float voxelSize,
+		bool parallel,
+		sensor_msgs::PointCloud2 & msg)
+{
+	UASSERT(depth.type() == CV_16UC1 || depth.type() == CV_32FC1);
+	UASSERT(rgb.empty() || (rgb.type() == CV_8UC3 || rgb.type() == CV_8UC1));
+	UASSERT(rgb.empty() || (rgb.rows == depth.rows && rgb.cols == depth.cols));
+	UASSERT(fx > 0.0f && fy > 0.0f);
+	if(decimation < 1)
+	{
+		decimation = 1;
+	}
+
+	int width = depth.cols/decimation;
+	int height = depth.rows/decimation;
+	std::vector<float> xFactors(width);
+	for(int j=0; j<width; ++j)
+	{
+		xFactors[j] = (float(j*decimation) - cx) / fx;
+	}
+
+	sensor_msgs::PointCloud2Modifier modifier(msg);
+	if(rgb.empty())
+	{
+		modifier.setPointCloud2FieldsByString(1, "xyz");
+	}
+	else
+	{
+		modifier.setPointCloud2FieldsByString(2, "xyz", "rgb");
+	}
+
+	if(voxelSize <= 0.0f)
+	{
+		msg.height = height;
+		msg.width = width;
+		msg.row_step = msg.width * msg.point_step;
+		msg.data.resize(msg.height * msg.row_step);
+		msg.is_dense = false;
+	}
+
+	VoxelMap voxels;
+	boost::mutex voxelsMutex;
+	DepthToCloudBody body(depth, rgb, xFactors, fy, cy, decimation, maxDepth, voxelSize, msg, voxels, voxelsMutex);
+	if(parallel)
+	{
+		cv::parallel_for_(cv::Range(0, height), body);
+	}
+	else
+	{
+		body(cv::Range(0, height));
+	}
+
+	if(voxelSize > 0.0f)
+	{
+		// centroids
+		modifier.resize(voxels.size());
+		msg.is_dense = true;
+		sensor_msgs::PointCloud2Iterator<float> iterX(msg, "x");
+		for(VoxelMap::iterator iter=voxels.begin(); iter!=voxels.end(); ++iter, ++iterX)
+		{
+			float n = float(iter->second.n);
+			iterX[0] = iter->second.x / n;
+			iterX[1] = iter->second.y / n;
+			iterX[2] = iter->second.z / n;
+			if(!rgb.empty())
+			{
+				unsigned char * bgr = (unsigned char*)&iterX[4]; // offset 16
+				bgr[0] = (unsigned char)(iter->second.b / n);
+				bgr[1] = (unsigned char)(iter->second.g / n);
+				bgr[2] = (unsigned char)(iter->second.r / n);
+				bgr[3] = 255;
+			}
+		}
+	}
+}
+
+}
@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ros/ros.h>
 #include "rtabmap_ros/MapData.h"
 #include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/PosesGridIndex.h"
 #include <rtabmap/core/util3d_mapping.h>
 #include <rtabmap/core/Graph.h>
 #include <rtabmap/core/Compression.h>
@@ -107,7 +108,8 @@ public:
 
 		if(filterRadius_ > 0.0 && filterAngle_ > 0.0)
 		{
-			poses = rtabmap::graph::radiusPosesFiltering(poses, filterRadius_, filterAngle_*CV_PI/180.0);
+			posesIndex_.update(poses);
+			poses = posesIndex_.radiusPosesFiltering(filterRadius_, filterAngle_*CV_PI/180.0);
 		}
 
 		if(gridMap_.getNumSubscribers())
@@ -166,6 +168,7 @@ public:
 	{
 		ROS_INFO("grid_map_assembler: reset!");
 		gridMaps_.clear();
+		posesIndex_.clear();
 		map_ = nav_msgs::OccupancyGrid();
 		return true;
 	}
@@ -185,6 +188,7 @@ private:
 	ros::ServiceServer resetService_;
 
 	std::map<int, std::pair<cv::Mat, cv::Mat> > gridMaps_; //<ground,obstacles>
+	rtabmap_ros::PosesGridIndex posesIndex_;
 
 	nav_msgs::OccupancyGrid map_;
 };
@@ -0,0 +1,325 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/GroundSegmentation.h"
+
+#include <pcl/common/point_tests.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/PointIndices.h>
+#include <pcl/segmentation/sac_segmentation.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#define MAX_CELL_COORDINATE 1000000000 // the cell size is doubled until the cell coordinates fit in an int
+
+namespace rtabmap_ros {
+
+Eigen::Vector4f fitGroundPlane(
+		const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud,
+		const pcl::IndicesPtr & indices,
+		float groundNormalAngle,
+		float distanceThreshold)
+{
+	Eigen::Vector4f plane = Eigen::Vector4f::Zero();
+	if((indices.get()?indices->size():cloud->size()) < 3)
+	{
+		return plane;
+	}
+
+	pcl::SACSegmentation<pcl::PointXYZ> seg;
+	seg.setOptimizeCoefficients(true);
+	seg.setModelType(pcl::SACMODEL_PERPENDICULAR_PLANE);
+	seg.setMethodType(pcl::SAC_RANSAC);
+	seg.setAxis(Eigen::Vector3f(0,0,1));
+	seg.setEpsAngle(groundNormalAngle);
+	seg.setDistanceThreshold(distanceThreshold);
+	seg.setInputCloud(cloud);
+	if(indices.get())
+	{
+		seg.setIndices(indices);
+	}
+	pcl::ModelCoefficients coefficients;
+	pcl::PointIndices inliers;
+	seg.segment(inliers, coefficients);
+
+	if(coefficients.values.size() == 4 && inliers.indices.size())
+	{
+		plane = Eigen::Vector4f(
+				coefficients.values[0],
+				coefficients.values[1],
+				coefficients.values[2],
+				coefficients.values[3]);
+		if(plane[2] < 0.0f)
+		{
+			// normal pointing up
+			plane *= -1.0f;
+		}
+	}
+	return plane;
+}
+
+static unsigned long long cellKey(int x, int y)
+{
+	return ((unsigned long long)(unsigned int)x << 32) | (unsigned int)y;
+}
+
+static int findCell(const HeightGridBuffers & buffers, int x, int y)
+{
+	if(x < 0 || y < 0)
+	{
+		return -1;
+	}
+	boost::unordered_map<unsigned long long, int>::const_iterator iter = buffers.cells.find(cellKey(x, y));
+	return iter!=buffers.cells.end()?iter->second:-1;
+}
+
+void segmentObstaclesFromHeightGrid(
+		const pcl::PointCloud<pcl::PointXYZ> & cloud,
+		const pcl::IndicesConstPtr & indices,
+		float cellSize,
+		float maxGroundStep,
+		float groundNormalAngle,
+		float maxGroundHeight,
+		bool ransacPlane,
+		int minClusterSize,
+		pcl::IndicesPtr & ground,
+		pcl::IndicesPtr & obstacles,
+		Eigen::Vector4f * groundPlane,
+		const Eigen::Vector4f * referencePlane,
+		HeightGridBuffers * buffers)
+{
+	UASSERT(cellSize > 0.0f);
+	ground.reset(new std::vector<int>);
+	obstacles.reset(new std::vector<int>);
+	if(groundPlane)
+	{
+		*groundPlane = Eigen::Vector4f::Zero();
+	}
+
+	HeightGridBuffers localBuffers;
+	HeightGridBuffers & b = buffers?*buffers:localBuffers;
+	b.points.clear();
+	b.pointCells.clear();
+	b.cells.clear();
+	b.cellX.clear();
+	b.cellY.clear();
+	b.cellMinZ.clear();
+	b.cellMinIndex.clear();
+	b.groundCells.clear();
+	b.cellObstacles.clear();
+	b.cellClusters.clear();
+
+	// valid points and bounds
+	int size = indices.get()?(int)indices->size():(int)cloud.size();
+	b.points.reserve(size);
+	float minX = std::numeric_limits<float>::max();
+	float minY = std::numeric_limits<float>::max();
+	float maxX = -std::numeric_limits<float>::max();
+	float maxY = -std::numeric_limits<float>::max();
+	for(int i=0; i<size; ++i)
+	{
+		int index = indices.get()?indices->at(i):i;
+		const pcl::PointXYZ & pt = cloud.at(index);
+		if(pcl::isFinite(pt))
+		{
+			b.points.push_back(index);
+			if(pt.x < minX) minX = pt.x;
+			if(pt.x > maxX) maxX = pt.x;
+			if(pt.y < minY) minY = pt.y;
+			if(pt.y > maxY) maxY = pt.y;
+		}
+	}
+	if(b.points.empty())
+	{
+		return;
+	}
+
+	while((maxX-minX)/cellSize > MAX_CELL_COORDINATE || (maxY-minY)/cellSize > MAX_CELL_COORDINATE)
+	{
+		cellSize *= 2.0f;
+	}
+
+	// lowest point of each occupied cell, only occupied cells are stored
+	b.pointCells.resize(b.points.size());
+	for(unsigned int i=0; i<b.points.size(); ++i)
+	{
+		const pcl::PointXYZ & pt = cloud.at(b.points[i]);
+		int x = int((pt.x-minX)/cellSize);
+		int y = int((pt.y-minY)/cellSize);
+		std::pair<boost::unordered_map<unsigned long long, int>::iterator, bool> inserted =
+				b.cells.insert(std::make_pair(cellKey(x, y), (int)b.cellX.size()));
+		int cell = inserted.first->second;
+		if(inserted.second)
+		{
+			b.cellX.push_back(x);
+			b.cellY.push_back(y);
+			b.cellMinZ.push_back(pt.z);
+			b.cellMinIndex.push_back(b.points[i]);
+		}
+		else if(pt.z < b.cellMinZ[cell])
+		{
+			b.cellMinZ[cell] = pt.z;
+			b.cellMinIndex[cell] = b.points[i];
+		}
+		b.pointCells[i] = cell;
+	}
+	int cellsCount = (int)b.cellX.size();
+
+	// ground cells: not higher than their neighbors more than the allowed slope
+	float maxRise = cellSize*std::tan(groundNormalAngle) + maxGroundStep;
+	b.groundCells.resize(cellsCount, 0);
+	std::vector<int> candidates;
+	for(int cell=0; cell<cellsCount; ++cell)
+	{
+		if(maxGroundHeight > 0.0f && b.cellMinZ[cell] > maxGroundHeight)
+		{
+			continue;
+		}
+		bool flat = true;
+		for(int nx=b.cellX[cell]-1; flat && nx<=b.cellX[cell]+1; ++nx)
+		{
+			for(int ny=b.cellY[cell]-1; flat && ny<=b.cellY[cell]+1; ++ny)
+			{
+				int n = findCell(b, nx, ny);
+				flat = n < 0 || b.cellMinZ[n] >= b.cellMinZ[cell] - maxRise;
+			}
+		}
+		if(flat)
+		{
+			b.groundCells[cell] = 1;
+			candidates.push_back(cell);
+		}
+	}
+
+	// Only one point per cell is used, so RANSAC is cheap
+	Eigen::Vector4f plane = Eigen::Vector4f::Zero();
+	if(referencePlane)
+	{
+		plane = *referencePlane;
+	}
+	else if(ransacPlane && candidates.size() >= 3)
+	{
+		pcl::PointCloud<pcl::PointXYZ>::Ptr lowest(new pcl::PointCloud<pcl::PointXYZ>);
+		lowest->resize(candidates.size());
+		for(unsigned int i=0; i<candidates.size(); ++i)
+		{
+			lowest->at(i) = cloud.at(b.cellMinIndex[candidates[i]]);
+		}
+		plane = fitGroundPlane(lowest, pcl::IndicesPtr(), groundNormalAngle, maxGroundStep);
+	}
+	if(plane != Eigen::Vector4f::Zero())
+	{
+		for(unsigned int i=0; i<candidates.size(); ++i)
+		{
+			const pcl::PointXYZ & pt = cloud.at(b.cellMinIndex[candidates[i]]);
+			if(std::fabs(plane.dot(Eigen::Vector4f(pt.x, pt.y, pt.z, 1.0f))) > maxGroundStep)
+			{
+				b.groundCells[candidates[i]] = 0;
+			}
+		}
+		if(groundPlane)
+		{
+			*groundPlane = plane;
+		}
+	}
+
+	// points near the bottom of ground cells are ground
+	b.cellObstacles.resize(cellsCount, 0);
+	std::vector<int> obstaclePoints;
+	ground->reserve(b.points.size());
+	for(unsigned int i=0; i<b.points.size(); ++i)
+	{
+		int cell = b.pointCells[i];
+		if(b.groundCells[cell] && cloud.at(b.points[i]).z - b.cellMinZ[cell] <= maxGroundStep)
+		{
+			ground->push_back(b.points[i]);
+		}
+		else
+		{
+			++b.cellObstacles[cell];
+			obstaclePoints.push_back(i);
+		}
+	}
+
+	if(minClusterSize <= 1)
+	{
+		obstacles->resize(obstaclePoints.size());
+		for(unsigned int i=0; i<obstaclePoints.size(); ++i)
+		{
+			obstacles->at(i) = b.points[obstaclePoints[i]];
+		}
+		return;
+	}
+
+	// clusters of 8-connected obstacle cells
+	b.cellClusters.resize(cellsCount, -1);
+	std::vector<int> clusterSizes;
+	std::vector<int> stack;
+	for(int cell=0; cell<cellsCount; ++cell)
+	{
+		if(b.cellObstacles[cell] == 0 || b.cellClusters[cell] >= 0)
+		{
+			continue;
+		}
+		int id = (int)clusterSizes.size();
+		clusterSizes.push_back(0);
+		b.cellClusters[cell] = id;
+		stack.push_back(cell);
+		while(stack.size())
+		{
+			int current = stack.back();
+			stack.pop_back();
+			clusterSizes[id] += b.cellObstacles[current];
+			for(int nx=b.cellX[current]-1; nx<=b.cellX[current]+1; ++nx)
+			{
+				for(int ny=b.cellY[current]-1; ny<=b.cellY[current]+1; ++ny)
+				{
+					int n = findCell(b, nx, ny);
+					if(n >= 0 && b.cellObstacles[n] && b.cellClusters[n] < 0)
+					{
+						b.cellClusters[n] = id;
+						stack.push_back(n);
+					}
+				}
+			}
+		}
+	}
+
+	obstacles->reserve(obstaclePoints.size());
+	for(unsigned int i=0; i<obstaclePoints.size(); ++i)
+	{
+		if(clusterSizes[b.cellClusters[b.pointCells[obstaclePoints[i]]]] >= minClusterSize)
+		{
+			obstacles->push_back(b.points[obstaclePoints[i]]);
+		}
+	}
+}
+
+}
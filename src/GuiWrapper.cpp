@@ -571,11 +571,11 @@ void GuiWrapper::commonDepthCallback(
 			else if(imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 			   imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
 			{
-				ptrImage = cv_bridge::toCvShare(imageMsgs[i], "mono8");
+				ptrImage = rtabmap_ros::toCvShareCached(imageMsgs[i], "mono8");
 			}
 			else
 			{
-				ptrImage = cv_bridge::toCvShare(imageMsgs[i], "bgr8");
+				ptrImage = rtabmap_ros::toCvShareCached(imageMsgs[i], "bgr8");
 			}
 			cv_bridge::CvImageConstPtr ptrDepth = cv_bridge::toCvShare(depthMsgs[i]);
 			cv::Mat subDepth = ptrDepth->image;
@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/ImageDecimation.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <rtabmap/utilite/ULogger.h>
+#include <vector>
+
+namespace rtabmap_ros {
+
+// For each output row, the valid depths of the "decimation" input rows are
+// first summed per column, then per block of columns. The inner loops are
+// branchless over contiguous memory so that the compiler can vectorize them.
+template<typename T>
+class DepthDecimationBody : public cv::ParallelLoopBody
+{
+public:
+	DepthDecimationBody(const cv::Mat & depth, int decimation, const cv::Mat & output) :
+		depth_(depth),
+		decimation_(decimation),
+		output_(output)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		int inCols = output_.cols * decimation_;
+		std::vector<float> sums(inCols);
+		std::vector<float> counts(inCols);
+		for(int v=range.start; v<range.end; ++v)
+		{
+			std::fill(sums.begin(), sums.end(), 0.0f);
+			std::fill(counts.begin(), counts.end(), 0.0f);
+			for(int k=0; k<decimation_; ++k)
+			{
+				const T * in = depth_.ptr<T>(v*decimation_ + k);
+				for(int u=0; u<inCols; ++u)
+				{
+					float d = float(in[u]);
+					float valid = d > 0.0f ? 1.0f : 0.0f; // false for NaN
+					sums[u] += d > 0.0f ? d : 0.0f;
+					counts[u] += valid;
+				}
+			}
+
+			T * out = output_.ptr<T>(v);
+			for(int u=0; u<output_.cols; ++u)
+			{
+				float sum = 0.0f;
+				float count = 0.0f;
+				for(int k=u*decimation_; k<(u+1)*decimation_; ++k)
+				{
+					sum += sums[k];
+					count += counts[k];
+				}
+				out[u] = count > 0.0f ? cv::saturate_cast<T>(sum / count) : T(0);
+			}
+		}
+	}
+
+private:
+	cv::Mat depth_;
+	int decimation_;
+	cv::Mat output_;
+};
+
+void decimateImage(const cv::Mat & image, int decimation, bool depth, cv::Mat & output)
+{
+	UASSERT(decimation >= 1);
+	UASSERT(output.type() == image.type() &&
+			output.rows == image.rows/decimation &&
+			output.cols == image.cols/decimation);
+
+	if(output.empty())
+	{
+		return;
+	}
+	if(decimation == 1)
+	{
+		image.copyTo(output);
+	}
+	else if(depth)
+	{
+		UASSERT_MSG(image.type() == CV_16UC1 || image.type() == CV_32FC1, "Depth should be 16UC1 or 32FC1");
+		if(image.type() == CV_16UC1)
+		{
+			cv::parallel_for_(cv::Range(0, output.rows), DepthDecimationBody<unsigned short>(image, decimation, output));
+		}
+		else
+		{
+			cv::parallel_for_(cv::Range(0, output.rows), DepthDecimationBody<float>(image, decimation, output));
+		}
+	}
+	else
+	{
+		// same size as output, so resize() writes in place
+		cv::resize(image(cv::Rect(0, 0, output.cols*decimation, output.rows*decimation)), output, output.size(), 0, 0, cv::INTER_AREA);
+	}
+}
+
+}
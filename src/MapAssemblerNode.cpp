@@ -28,6 +28,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ros/ros.h>
 #include "rtabmap_ros/MapData.h"
 #include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/PosesGridIndex.h"
+#include "rtabmap_ros/GetMapRegion.h"
 #include <rtabmap/core/util3d_transforms.h>
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/util3d_filtering.h>
@@ -99,6 +101,7 @@ public:
 
 		// private service
 		resetService_ = pnh.advertiseService("reset", &MapAssembler::reset, this);
+		getMapRegionService_ = pnh.advertiseService("get_map_region", &MapAssembler::getMapRegion, this);
 	}
 
 	~MapAssembler()
@@ -196,9 +199,11 @@ public:
 		{
 			poses.insert(std::make_pair(msg->posesId[i], rtabmap_ros::transformFromPoseMsg(msg->poses[i])));
 		}
+		posesIndex_.update(poses);
+		mapFrameId_ = msg->header.frame_id;
 		if(nodeFilteringAngle_ > 0.0 && nodeFilteringRadius_ > 0.0)
 		{
-			poses = rtabmap::graph::radiusPosesFiltering(poses, nodeFilteringRadius_, nodeFilteringAngle_*CV_PI/180.0);
+			poses = posesIndex_.radiusPosesFiltering(nodeFilteringRadius_, nodeFilteringAngle_*CV_PI/180.0);
 		}
 
 		if(assembledMapClouds_.getNumSubscribers())
@@ -307,6 +312,90 @@ public:
 		occupancyLocalMaps_.clear();
 		rgbClouds_.clear();
 		scans_.clear();
+		posesIndex_.clear();
+		return true;
+	}
+
+	bool getMapRegion(rtabmap_ros::GetMapRegion::Request& req, rtabmap_ros::GetMapRegion::Response& res)
+	{
+		Transform center = rtabmap_ros::transformFromPoseMsg(req.center);
+		if(center.isNull() || (req.radius <= 0.0f && (req.boxHalfSize.x <= 0.0 || req.boxHalfSize.y <= 0.0 || req.boxHalfSize.z <= 0.0)))
+		{
+			ROS_ERROR("map_assembler: get_map_region: center should be valid and radius or box half size should be > 0");
+			return false;
+		}
+
+		std::vector<int> ids;
+		if(req.radius > 0.0f)
+		{
+			ids = posesIndex_.radiusSearch(center, req.radius);
+		}
+		else
+		{
+			ids = posesIndex_.boxSearch(
+					center.x()-req.boxHalfSize.x, center.y()-req.boxHalfSize.y, center.z()-req.boxHalfSize.z,
+					center.x()+req.boxHalfSize.x, center.y()+req.boxHalfSize.y, center.z()+req.boxHalfSize.z);
+		}
+		const std::map<int, Transform> & filteredPoses = nodeFilteringAngle_ > 0.0 && nodeFilteringRadius_ > 0.0?
+				posesIndex_.radiusPosesFiltering(nodeFilteringRadius_, nodeFilteringAngle_*CV_PI/180.0):
+				posesIndex_.poses();
+		std::map<int, Transform> poses;
+		for(unsigned int i=0; i<ids.size(); ++i)
+		{
+			std::map<int, Transform>::const_iterator iter = filteredPoses.find(ids[i]);
+			if(iter != filteredPoses.end())
+			{
+				poses.insert(poses.end(), *iter);
+			}
+		}
+		res.nodeIds = uKeys(poses);
+		ros::Time now = ros::Time::now();
+
+		if(req.cloud && poses.size())
+		{
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledCloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+			for(std::map<int, Transform>::iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+			{
+				std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator jter = rgbClouds_.find(iter->first);
+				if(jter != rgbClouds_.end())
+				{
+					pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(jter->second, iter->second);
+					*assembledCloud+=*transformed;
+				}
+			}
+			if(assembledCloud->size() && cloudVoxelSize_ > 0)
+			{
+				assembledCloud = util3d::voxelize(assembledCloud,cloudVoxelSize_);
+			}
+			pcl::toROSMsg(*assembledCloud, res.cloud);
+			res.cloud.header.stamp = now;
+			res.cloud.header.frame_id = mapFrameId_;
+		}
+
+		// only projection maps are created by the assembler (see occupancy_grid parameter)
+		if(req.proj && computeOccupancyGrid_ && poses.size())
+		{
+			float xMin=0.0f, yMin=0.0f;
+			cv::Mat pixels = util3d::create2DMapFromOccupancyLocalMaps(
+					poses,
+					occupancyLocalMaps_,
+					gridCellSize_, xMin, yMin,
+					occupancyMapSize_);
+			if(!pixels.empty())
+			{
+				res.proj.info.resolution = gridCellSize_;
+				res.proj.info.origin.position.x = xMin;
+				res.proj.info.origin.position.y = yMin;
+				res.proj.info.origin.position.z = 0.0;
+				res.proj.info.origin.orientation.w = 1.0;
+				res.proj.info.width = pixels.cols;
+				res.proj.info.height = pixels.rows;
+				res.proj.data.resize(res.proj.info.width * res.proj.info.height);
+				memcpy(res.proj.data.data(), pixels.data, res.proj.info.width * res.proj.info.height);
+				res.proj.header.frame_id = mapFrameId_;
+				res.proj.header.stamp = now;
+			}
+		}
 		return true;
 	}
 
@@ -338,9 +427,12 @@ private:
 	ros::Publisher occupancyMapPub_;
 
 	ros::ServiceServer resetService_;
+	ros::ServiceServer getMapRegionService_;
 
 	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr > rgbClouds_;
 	std::map<int, pcl::PointCloud<pcl::PointXYZ>::Ptr > scans_;
+	rtabmap_ros::PosesGridIndex posesIndex_;
+	std::string mapFrameId_;
 };
 
 
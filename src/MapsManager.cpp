@@ -11,6 +11,8 @@
 #include <rtabmap/utilite/UTimer.h>
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UFile.h>
+#include <rtabmap/utilite/UThread.h>
 #include <rtabmap/core/util3d_mapping.h>
 #include <rtabmap/core/util3d_filtering.h>
 #include <rtabmap/core/util3d_transforms.h>
@@ -19,9 +21,20 @@
 #include <rtabmap/core/Graph.h>
 
 #include <nav_msgs/OccupancyGrid.h>
+#include <rtabmap_ros/MapCompleteness.h>
+#include <std_msgs/Float32.h>
 #include <ros/ros.h>
 
 #include <pcl_conversions/pcl_conversions.h>
+#include <boost/unordered_set.hpp>
+#include <cmath>
+#include <deque>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #ifdef WITH_OCTOMAP
 #include <octomap/octomap.h>
@@ -29,7 +42,8 @@
 
 using namespace rtabmap;
 
-MapsManager::MapsManager() :
+MapsManager::MapsManager(const ros::NodeHandle & nh, const ros::NodeHandle & pnh) :
+		nh_(nh),
 		cloudDecimation_(4),
 		cloudMaxDepth_(4.0), // meters
 		cloudVoxelSize_(0.05), // meters
@@ -43,15 +57,25 @@ MapsManager::MapsManager() :
 		mapFilterRadius_(0.5),
 		mapFilterAngle_(30.0), // degrees
 		mapCacheCleanup_(true),
+		mapUpdateTimeBudget_(0.0),
+		warmUpCloud_(false),
+		warmUpProj_(false),
+		warmUpGrid_(false),
 		laserScanMaxRange_(0),
 		laserScanMinAngle_(0),
 		laserScanMaxAngle_(0),
-		laserScanIncrement_(0)
+		laserScanIncrement_(0),
+		warmUpRunning_(false),
+		warmUpMemory_(0),
+		warmUpThread_(0),
+		warmUpAllQueued_(false),
+		warmUpCanceled_(false),
+		exportMemory_(0),
+		exportThread_(0),
+		exportAllQueued_(false),
+		exportCanceled_(false),
+		exportFinished_(false)
 {
-
-	ros::NodeHandle nh;
-	ros::NodeHandle pnh("~");
-
 	// cloud map stuff
 	pnh.param("cloud_decimation", cloudDecimation_, cloudDecimation_);
 	pnh.param("cloud_max_depth", cloudMaxDepth_, cloudMaxDepth_);
@@ -72,11 +96,21 @@ MapsManager::MapsManager() :
 	pnh.param("map_filter_radius", mapFilterRadius_, mapFilterRadius_);
 	pnh.param("map_filter_angle", mapFilterAngle_, mapFilterAngle_);
 	pnh.param("map_cleanup", mapCacheCleanup_, mapCacheCleanup_);
+	// Max time (sec) spent to update the caches on each map update (0=no limit). Nodes
+	// closest to the robot are done first, the others in the next updates.
+	pnh.param("map_update_time_budget", mapUpdateTimeBudget_, mapUpdateTimeBudget_);
+
+	// prefill caches of the local map in background after the database is loaded
+	pnh.param("map_warm_up_cloud", warmUpCloud_, warmUpCloud_);
+	pnh.param("map_warm_up_proj", warmUpProj_, warmUpProj_);
+	pnh.param("map_warm_up_grid", warmUpGrid_, warmUpGrid_);
 
 	// mapping topics
-	cloudMapPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud_map", 1);
-	projMapPub_ = nh.advertise<nav_msgs::OccupancyGrid>("proj_map", 1);
-	gridMapPub_ = nh.advertise<nav_msgs::OccupancyGrid>("grid_map", 1);
+	cloudMapPub_ = nh_.advertise<sensor_msgs::PointCloud2>("cloud_map", 1);
+	projMapPub_ = nh_.advertise<nav_msgs::OccupancyGrid>("proj_map", 1);
+	gridMapPub_ = nh_.advertise<nav_msgs::OccupancyGrid>("grid_map", 1);
+	mapCompletenessPub_ = nh_.advertise<rtabmap_ros::MapCompleteness>("map_completeness", 1);
+	exportProgressPub_ = nh_.advertise<std_msgs::Float32>("export_map_progress", 1);
 }
 
 MapsManager::~MapsManager() {
@@ -85,9 +119,15 @@ MapsManager::~MapsManager() {
 
 void MapsManager::clear()
 {
+	stopWarmUp();
+	stopExport();
+
+	boost::recursive_mutex::scoped_lock lock(cachesMutex_);
 	clouds_.clear();
 	projMaps_.clear();
 	gridMaps_.clear();
+	localPosesIndex_.clear();
+	requestPosesIndex_.clear();
 	laserScanMaxRange_ = 0;
 	laserScanMinAngle_ = 0;
 	laserScanMaxAngle_ = 0;
@@ -119,7 +159,8 @@ std::map<int, Transform> MapsManager::getFilteredPoses(const std::map<int, Trans
 	{
 		// filter nodes
 		double angle = mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0;
-		return rtabmap::graph::radiusPosesFiltering(poses, mapFilterRadius_, angle);
+		requestPosesIndex_.update(poses);
+		return requestPosesIndex_.radiusPosesFiltering(mapFilterRadius_, angle);
 	}
 	return std::map<int, Transform>();
 }
@@ -132,12 +173,19 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 		bool updateGrid,
 		const std::map<int, rtabmap::Signature> & signatures)
 {
+	double timeBudget = 0.0;
 	if(!updateCloud && !updateProj && !updateGrid)
 	{
 		//  all false, udpate only those where we have subscribers
 		updateCloud = cloudMapPub_.getNumSubscribers() != 0;
 		updateProj = projMapPub_.getNumSubscribers() != 0;
 		updateGrid = gridMapPub_.getNumSubscribers() != 0;
+
+		// periodic update for the subscribers, maps can be completed in the next updates
+		if(signatures.size() == 0)
+		{
+			timeBudget = mapUpdateTimeBudget_;
+		}
 	}
 
 	UDEBUG("Updating map caches...");
@@ -153,11 +201,16 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 	// update cache
 	if(updateCloud || updateProj || updateGrid)
 	{
+		boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+
 		// filter nodes
 		if(mapFilterRadius_ > 0.0)
 		{
 			double angle = mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0;
-			filteredPoses = rtabmap::graph::radiusPosesFiltering(poses, mapFilterRadius_, angle);
+			// poses of the requests (given signatures) are not the local graph
+			rtabmap_ros::PosesGridIndex & index = signatures.size()?requestPosesIndex_:localPosesIndex_;
+			index.update(poses);
+			filteredPoses = index.radiusPosesFiltering(mapFilterRadius_, angle);
 		}
 		else
 		{
@@ -165,132 +218,7 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 		}
 
 
-		for(std::map<int, rtabmap::Transform>::iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
-		{
-			if(!iter->second.isNull())
-			{
-				rtabmap::SensorData data;
-				bool rgbDepthRequired = updateCloud && !uContains(clouds_, iter->first);
-				bool depthRequired = updateProj && !uContains(projMaps_, iter->first);
-				bool scanRequired = updateGrid && !uContains(gridMaps_, iter->first);
-				if(rgbDepthRequired ||
-					depthRequired ||
-					scanRequired)
-				{
-					if(signatures.size())
-					{
-						std::map<int, rtabmap::Signature>::const_iterator findIter = signatures.find(iter->first);
-						if(findIter != signatures.end())
-						{
-							data = findIter->second.sensorData();
-						}
-					}
-					else
-					{
-						data = memory->getSignatureDataConst(iter->first);
-					}
-				}
-
-				if(data.id() > 0)
-				{
-					if(!data.imageCompressed().empty() &&
-					   !data.depthOrRightCompressed().empty() &&
-					   (data.cameraModels().size() || data.stereoCameraModel().isValid()))
-					{
-						// Which data should we decompress?
-						cv::Mat image, depth, scan;
-						data.uncompressData(
-								(rgbDepthRequired||data.stereoCameraModel().isValid()) ? &image:0,
-								(rgbDepthRequired||depthRequired) ? &depth:0,
-								scanRequired?&scan:0);
-
-						pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloudRGB;
-						pcl::PointCloud<pcl::PointXYZ>::Ptr cloudXYZ;
-						if(rgbDepthRequired)
-						{
-							if(!image.empty() && !depth.empty())
-							{
-								cloudRGB = util3d::cloudRGBFromSensorData(
-										data,
-										cloudDecimation_,
-										cloudMaxDepth_,
-										cloudVoxelSize_);
-							}
-							else
-							{
-								ROS_ERROR("RGB or Depth image not found (node=%d)!", iter->first);
-							}
-						}
-						else if(depthRequired)
-						{
-							if(	!depth.empty())
-							{
-								cloudXYZ = util3d::cloudFromSensorData(
-										data,
-										cloudDecimation_,
-										cloudMaxDepth_,
-										gridCellSize_); // use gridCellSize since this cloud is only for the projection map
-							}
-							else
-							{
-								ROS_ERROR("RGB or Depth image not found (node=%d)!", iter->first);
-							}
-						}
-
-						if(cloudRGB.get())
-						{
-							clouds_.insert(std::make_pair(iter->first, cloudRGB));
-						}
-
-						if(depthRequired)
-						{
-							cv::Mat ground, obstacles;
-							if(cloudRGB.get())
-							{
-								pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloudClipped = cloudRGB;
-								if(cloudClipped->size() && projMaxHeight_ > 0)
-								{
-									cloudClipped = util3d::passThrough(cloudClipped, "z", std::numeric_limits<int>::min(), projMaxHeight_);
-								}
-								if(cloudClipped->size())
-								{
-									cloudClipped = util3d::voxelize(cloudClipped, gridCellSize_);
-									util3d::occupancy2DFromCloud3D<pcl::PointXYZRGB>(cloudClipped, ground, obstacles, gridCellSize_, projMaxGroundAngle_*M_PI/180.0, projMinClusterSize_);
-								}
-							}
-							else if(cloudXYZ.get())
-							{
-								pcl::PointCloud<pcl::PointXYZ>::Ptr cloudClipped = cloudXYZ;
-								if(cloudClipped->size() && projMaxHeight_ > 0)
-								{
-									cloudClipped = util3d::passThrough(cloudClipped, "z", std::numeric_limits<int>::min(), projMaxHeight_);
-								}
-								if(cloudClipped->size())
-								{
-									util3d::occupancy2DFromCloud3D<pcl::PointXYZ>(cloudClipped, ground, obstacles, gridCellSize_, projMaxGroundAngle_*M_PI/180.0, projMinClusterSize_);
-								}
-							}
-							projMaps_.insert(std::make_pair(iter->first, std::make_pair(ground, obstacles)));
-						}
-
-						if(scanRequired)
-						{
-							cv::Mat ground, obstacles;
-							util3d::occupancy2DFromLaserScan(scan, ground, obstacles, gridCellSize_);
-							gridMaps_.insert(std::make_pair(iter->first, std::make_pair(ground, obstacles)));
-						}
-					}
-					else
-					{
-						ROS_ERROR("Local transform detected for node %d", iter->first);
-					}
-				}
-			}
-			else
-			{
-				ROS_ERROR("Pose null for node %d", iter->first);
-			}
-		}
+		fillMapCaches(filteredPoses, memory, updateCloud, updateProj, updateGrid, timeBudget, signatures);
 
 		// cleanup not used nodes
 		for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=clouds_.begin();
@@ -334,6 +262,237 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 	return filteredPoses;
 }
 
+void MapsManager::fillMapCaches(
+		const std::map<int, rtabmap::Transform> & filteredPoses,
+		const rtabmap::Memory * memory,
+		bool updateCloud,
+		bool updateProj,
+		bool updateGrid,
+		double timeBudget,
+		const std::map<int, rtabmap::Signature> & signatures)
+{
+	boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+
+	std::vector<std::map<int, rtabmap::Transform>::const_iterator> nodes;
+	nodes.reserve(filteredPoses.size());
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
+	{
+		nodes.push_back(iter);
+	}
+	if(timeBudget > 0.0 && filteredPoses.size() && !filteredPoses.rbegin()->second.isNull())
+	{
+		// nodes closest to the latest one (where the robot is) first
+		const Transform & currentPose = filteredPoses.rbegin()->second;
+		std::multimap<float, std::map<int, rtabmap::Transform>::const_iterator> nodesByDistance;
+		for(unsigned int i=0; i<nodes.size(); ++i)
+		{
+			float d = nodes[i]->second.isNull()?std::numeric_limits<float>::max():currentPose.getDistance(nodes[i]->second);
+			nodesByDistance.insert(std::make_pair(d, nodes[i]));
+		}
+		nodes = uValues(nodesByDistance);
+	}
+
+	UTimer timer;
+	int postponed = 0;
+	for(unsigned int i=0; i<nodes.size(); ++i)
+	{
+		std::map<int, rtabmap::Transform>::const_iterator iter = nodes[i];
+		if(!iter->second.isNull())
+		{
+			rtabmap::SensorData data;
+			bool rgbDepthRequired = updateCloud && !uContains(clouds_, iter->first);
+			bool depthRequired = updateProj && !uContains(projMaps_, iter->first);
+			bool scanRequired = updateGrid && !uContains(gridMaps_, iter->first);
+			if(rgbDepthRequired ||
+				depthRequired ||
+				scanRequired)
+			{
+				if(timeBudget > 0.0 && timer.elapsed() > timeBudget)
+				{
+					// done in the next updates
+					++postponed;
+					continue;
+				}
+				if(signatures.size())
+				{
+					std::map<int, rtabmap::Signature>::const_iterator findIter = signatures.find(iter->first);
+					if(findIter != signatures.end())
+					{
+						data = findIter->second.sensorData();
+					}
+				}
+				else
+				{
+					data = memory->getSignatureDataConst(iter->first);
+				}
+			}
+
+			if(data.id() > 0)
+			{
+				createLocalMaps(data, rgbDepthRequired, depthRequired, scanRequired);
+			}
+		}
+		else
+		{
+			ROS_ERROR("Pose null for node %d", iter->first);
+		}
+	}
+	if(postponed)
+	{
+		ROS_INFO("Map caches update reached the time budget (%fs), %d nodes postponed to next updates",
+				timeBudget, postponed);
+	}
+}
+
+std::map<int, rtabmap::Transform> MapsManager::updateRegionMapCaches(
+		const std::map<int, rtabmap::Transform> & poses,
+		const rtabmap::Memory * memory,
+		const rtabmap::Transform & center,
+		float radius,
+		const cv::Point3f & boxHalfSize,
+		bool updateCloud,
+		bool updateProj,
+		bool updateGrid)
+{
+	std::map<int, rtabmap::Transform> regionPoses;
+	if(!memory || center.isNull())
+	{
+		return regionPoses;
+	}
+
+	localPosesIndex_.update(poses);
+	std::vector<int> ids;
+	if(radius > 0.0f)
+	{
+		ids = localPosesIndex_.radiusSearch(center, radius);
+	}
+	else
+	{
+		ids = localPosesIndex_.boxSearch(
+				center.x()-boxHalfSize.x, center.y()-boxHalfSize.y, center.z()-boxHalfSize.z,
+				center.x()+boxHalfSize.x, center.y()+boxHalfSize.y, center.z()+boxHalfSize.z);
+	}
+
+	const std::map<int, rtabmap::Transform> & filteredPoses = mapFilterRadius_ > 0.0?
+			localPosesIndex_.radiusPosesFiltering(mapFilterRadius_, mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0):
+			localPosesIndex_.poses();
+	for(unsigned int i=0; i<ids.size(); ++i)
+	{
+		std::map<int, rtabmap::Transform>::const_iterator iter = filteredPoses.find(ids[i]);
+		if(iter != filteredPoses.end())
+		{
+			regionPoses.insert(regionPoses.end(), *iter);
+		}
+	}
+
+	// only nodes in the region are added to caches, nothing is removed
+	fillMapCaches(regionPoses, memory, updateCloud, updateProj, updateGrid, 0.0);
+
+	return regionPoses;
+}
+
+void MapsManager::createLocalMaps(
+		rtabmap::SensorData & data,
+		bool rgbDepthRequired,
+		bool depthRequired,
+		bool scanRequired)
+{
+	if(!data.imageCompressed().empty() &&
+	   !data.depthOrRightCompressed().empty() &&
+	   (data.cameraModels().size() || data.stereoCameraModel().isValid()))
+	{
+		// Which data should we decompress?
+		cv::Mat image, depth, scan;
+		data.uncompressData(
+				(rgbDepthRequired||data.stereoCameraModel().isValid()) ? &image:0,
+				(rgbDepthRequired||depthRequired) ? &depth:0,
+				scanRequired?&scan:0);
+
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloudRGB;
+		pcl::PointCloud<pcl::PointXYZ>::Ptr cloudXYZ;
+		if(rgbDepthRequired)
+		{
+			if(!image.empty() && !depth.empty())
+			{
+				cloudRGB = util3d::cloudRGBFromSensorData(
+						data,
+						cloudDecimation_,
+						cloudMaxDepth_,
+						cloudVoxelSize_);
+			}
+			else
+			{
+				ROS_ERROR("RGB or Depth image not found (node=%d)!", data.id());
+			}
+		}
+		else if(depthRequired)
+		{
+			if(	!depth.empty())
+			{
+				cloudXYZ = util3d::cloudFromSensorData(
+						data,
+						cloudDecimation_,
+						cloudMaxDepth_,
+						gridCellSize_); // use gridCellSize since this cloud is only for the projection map
+			}
+			else
+			{
+				ROS_ERROR("RGB or Depth image not found (node=%d)!", data.id());
+			}
+		}
+
+		if(cloudRGB.get())
+		{
+			boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+			clouds_.insert(std::make_pair(data.id(), cloudRGB));
+		}
+
+		if(depthRequired)
+		{
+			cv::Mat ground, obstacles;
+			if(cloudRGB.get())
+			{
+				pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloudClipped = cloudRGB;
+				if(cloudClipped->size() && projMaxHeight_ > 0)
+				{
+					cloudClipped = util3d::passThrough(cloudClipped, "z", std::numeric_limits<int>::min(), projMaxHeight_);
+				}
+				if(cloudClipped->size())
+				{
+					cloudClipped = util3d::voxelize(cloudClipped, gridCellSize_);
+					util3d::occupancy2DFromCloud3D<pcl::PointXYZRGB>(cloudClipped, ground, obstacles, gridCellSize_, projMaxGroundAngle_*M_PI/180.0, projMinClusterSize_);
+				}
+			}
+			else if(cloudXYZ.get())
+			{
+				pcl::PointCloud<pcl::PointXYZ>::Ptr cloudClipped = cloudXYZ;
+				if(cloudClipped->size() && projMaxHeight_ > 0)
+				{
+					cloudClipped = util3d::passThrough(cloudClipped, "z", std::numeric_limits<int>::min(), projMaxHeight_);
+				}
+				if(cloudClipped->size())
+				{
+					util3d::occupancy2DFromCloud3D<pcl::PointXYZ>(cloudClipped, ground, obstacles, gridCellSize_, projMaxGroundAngle_*M_PI/180.0, projMinClusterSize_);
+				}
+			}
+			boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+			projMaps_.insert(std::make_pair(data.id(), std::make_pair(ground, obstacles)));
+		}
+
+		if(scanRequired)
+		{
+			cv::Mat ground, obstacles;
+			util3d::occupancy2DFromLaserScan(scan, ground, obstacles, gridCellSize_);
+			boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+			gridMaps_.insert(std::make_pair(data.id(), std::make_pair(ground, obstacles)));
+		}
+	}
+	else
+	{
+		ROS_ERROR("Local transform detected for node %d", data.id());
+	}
+}
+
 void MapsManager::publishMaps(
 		const std::map<int, rtabmap::Transform> & poses,
 		const ros::Time & stamp,
@@ -341,31 +500,18 @@ void MapsManager::publishMaps(
 {
 	UDEBUG("Publishing maps...");
 
+	boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+
 	// publish maps
 	if(cloudMapPub_.getNumSubscribers())
 	{
 		// generate the assembled cloud!
 		UTimer time;
-		pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledCloud(new pcl::PointCloud<pcl::PointXYZRGB>);
-		int count = 0;
-		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
-		{
-			std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator jter = clouds_.find(iter->first);
-			if(jter != clouds_.end())
-			{
-				pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(jter->second, iter->second);
-				*assembledCloud+=*transformed;
-				++count;
-			}
-		}
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledCloud = assembleCloudMap(poses);
 
 		if(assembledCloud->size())
 		{
-			if(cloudVoxelSize_ > 0 && cloudOutputVoxelized_)
-			{
-				assembledCloud = util3d::voxelize(assembledCloud, cloudVoxelSize_);
-			}
-			ROS_INFO("Assembled %d clouds (%fs)", count, time.ticks());
+			ROS_INFO("Assembled %d clouds (%fs)", (int)poses.size(), time.ticks());
 
 			sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
 			pcl::toROSMsg(*assembledCloud, *cloudMsg);
@@ -378,7 +524,7 @@ void MapsManager::publishMaps(
 			ROS_WARN("Cloud map is empty! (clouds=%d)", (int)clouds_.size());
 		}
 	}
-	else if(mapCacheCleanup_)
+	else if(mapCacheCleanup_ && !(warmUpCloud_ && warmUpRunning_))
 	{
 		clouds_.clear();
 	}
@@ -420,7 +566,7 @@ void MapsManager::publishMaps(
 			ROS_WARN("Projection map is empty! (proj maps=%d)", (int)projMaps_.size());
 		}
 	}
-	else if(mapCacheCleanup_)
+	else if(mapCacheCleanup_ && !(warmUpProj_ && warmUpRunning_))
 	{
 		projMaps_.clear();
 	}
@@ -462,10 +608,54 @@ void MapsManager::publishMaps(
 			ROS_WARN("Grid map is empty! (local maps=%d)", (int)gridMaps_.size());
 		}
 	}
-	else if(mapCacheCleanup_)
+	else if(mapCacheCleanup_ && !(warmUpGrid_ && warmUpRunning_))
 	{
 		gridMaps_.clear();
 	}
+
+	if(mapCompletenessPub_.getNumSubscribers())
+	{
+		rtabmap_ros::MapCompletenessPtr msg(new rtabmap_ros::MapCompleteness);
+		msg->header.stamp = stamp;
+		msg->header.frame_id = mapFrameId;
+		msg->nodes = (int)poses.size();
+		msg->cloudNodes = 0;
+		msg->projNodes = 0;
+		msg->gridNodes = 0;
+		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+		{
+			msg->cloudNodes += uContains(clouds_, iter->first)?1:0;
+			msg->projNodes += uContains(projMaps_, iter->first)?1:0;
+			msg->gridNodes += uContains(gridMaps_, iter->first)?1:0;
+		}
+		msg->complete =
+				(!cloudMapPub_.getNumSubscribers() || msg->cloudNodes == msg->nodes) &&
+				(!projMapPub_.getNumSubscribers() || msg->projNodes == msg->nodes) &&
+				(!gridMapPub_.getNumSubscribers() || msg->gridNodes == msg->nodes);
+		mapCompletenessPub_.publish(msg);
+	}
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr MapsManager::assembleCloudMap(
+		const std::map<int, rtabmap::Transform> & poses)
+{
+	boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledCloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+	for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+	{
+		std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator jter = clouds_.find(iter->first);
+		if(jter != clouds_.end())
+		{
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(jter->second, iter->second);
+			*assembledCloud+=*transformed;
+		}
+	}
+
+	if(assembledCloud->size() && cloudVoxelSize_ > 0 && cloudOutputVoxelized_)
+	{
+		assembledCloud = util3d::voxelize(assembledCloud, cloudVoxelSize_);
+	}
+	return assembledCloud;
 }
 
 cv::Mat MapsManager::generateProjMap(
@@ -474,6 +664,7 @@ cv::Mat MapsManager::generateProjMap(
 		float & yMin,
 		float & gridCellSize)
 {
+	boost::recursive_mutex::scoped_lock lock(cachesMutex_);
 	gridCellSize = gridCellSize_;
 	return util3d::create2DMapFromOccupancyLocalMaps(
 			poses,
@@ -488,8 +679,10 @@ cv::Mat MapsManager::generateGridMap(
 		const std::map<int, rtabmap::Transform> & poses,
 		float & xMin,
 		float & yMin,
-		float & gridCellSize)
+		float & gridCellSize,
+		const rtabmap::Transform & currentPose)
 {
+	boost::recursive_mutex::scoped_lock lock(cachesMutex_);
 	gridCellSize = gridCellSize_;
 	cv::Mat map = util3d::create2DMapFromOccupancyLocalMaps(
 			poses,
@@ -499,17 +692,23 @@ cv::Mat MapsManager::generateGridMap(
 			gridSize_,
 			gridEroded_);
 
-	// Fill unknown space around the last pose
+	// Fill unknown space around the current pose
+	const Transform & pose = currentPose.isNull() && poses.size()?poses.rbegin()->second:currentPose;
+	cv::Point2i start;
+	if(!pose.isNull())
+	{
+		start = cv::Point2i((pose.x()-xMin)/gridCellSize_ + 0.5f, (pose.y()-yMin)/gridCellSize_ + 0.5f);
+	}
 	if(!map.empty() &&
 		laserScanMaxRange_ &&
 		laserScanMinAngle_ < laserScanMaxAngle_ &&
 		laserScanIncrement_ &&
-		poses.size())
+		!pose.isNull() &&
+		start.x >= 0 && start.x < map.cols &&
+		start.y >= 0 && start.y < map.rows)
 	{
-		const Transform & pose = poses.rbegin()->second;
 		float roll, pitch, yaw;
 		pose.getEulerAngles(roll, pitch, yaw);
-		cv::Point2i start((pose.x()-xMin)/gridCellSize_ + 0.5f, (pose.y()-yMin)/gridCellSize_ + 0.5f);
 
 		//rotate counterclockwise 180 degrees at the computed step "a" degrees
 		cv::Mat rotation = (cv::Mat_<float>(2,2) << cos(laserScanIncrement_), -sin(laserScanIncrement_),
@@ -544,6 +743,492 @@ cv::Mat MapsManager::generateGridMap(
 	return map;
 }
 
+// Nodes loaded from the memory (main thread) and processed by the
+// warm-up thread at the same time.
+#define WARM_UP_CHUNK_SIZE 10
+
+void MapsManager::startWarmUp(
+		const std::map<int, rtabmap::Transform> & poses,
+		const rtabmap::Memory * memory)
+{
+	stopWarmUp();
+
+	if(!isWarmUpEnabled() || poses.empty() || !memory)
+	{
+		return;
+	}
+
+	std::map<int, rtabmap::Transform> filteredPoses = poses;
+	if(mapFilterRadius_ > 0.0)
+	{
+		double angle = mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0;
+		localPosesIndex_.update(poses);
+		filteredPoses = localPosesIndex_.radiusPosesFiltering(mapFilterRadius_, angle);
+	}
+
+	// Nodes closest to the latest pose first, they are the ones
+	// the robot (and the first map subscribers) will look at.
+	const Transform & currentPose = poses.rbegin()->second;
+	std::multimap<float, int> nodesByDistance;
+	for(std::map<int, Transform>::iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
+	{
+		if(!iter->second.isNull())
+		{
+			nodesByDistance.insert(std::make_pair(currentPose.getDistance(iter->second), iter->first));
+		}
+	}
+
+	warmUpPending_.clear();
+	for(std::multimap<float, int>::iterator iter=nodesByDistance.begin(); iter!=nodesByDistance.end(); ++iter)
+	{
+		warmUpPending_.push_back(iter->second);
+	}
+	ROS_INFO("Map caches warm-up: %d nodes to process", (int)warmUpPending_.size());
+
+	if(warmUpPending_.size())
+	{
+		{
+			boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+			warmUpRunning_ = true;
+		}
+		warmUpQueue_.clear();
+		warmUpAllQueued_ = false;
+		warmUpCanceled_ = false;
+		warmUpMemory_ = memory;
+		warmUpThread_ = new boost::thread(boost::bind(&MapsManager::warmUpLoop, this));
+
+		// the memory is not thread-safe, nodes are loaded in the main thread
+		warmUpTimer_ = nh_.createTimer(ros::Duration(0.01), &MapsManager::warmUpTimerCallback, this);
+	}
+}
+
+void MapsManager::stopWarmUp()
+{
+	warmUpTimer_.stop();
+	if(warmUpThread_)
+	{
+		{
+			boost::mutex::scoped_lock lock(warmUpMutex_);
+			warmUpCanceled_ = true;
+		}
+		warmUpThread_->join();
+		delete warmUpThread_;
+		warmUpThread_ = 0;
+	}
+	warmUpPending_.clear();
+	warmUpQueue_.clear();
+	warmUpMemory_ = 0;
+	boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+	warmUpRunning_ = false;
+}
+
+// Only the (compressed) data is fetched here, a chunk at a time so that the
+// main thread is not blocked. Decompression and projection are done in the
+// background thread.
+void MapsManager::warmUpTimerCallback(const ros::TimerEvent &)
+{
+	int queued;
+	{
+		boost::mutex::scoped_lock lock(warmUpMutex_);
+		if(!warmUpMemory_ || warmUpCanceled_)
+		{
+			warmUpTimer_.stop();
+			return;
+		}
+		queued = (int)warmUpQueue_.size();
+	}
+
+	std::list<rtabmap::SensorData> data;
+	while(queued + (int)data.size() < WARM_UP_CHUNK_SIZE && warmUpPending_.size())
+	{
+		rtabmap::SensorData d = warmUpMemory_->getSignatureDataConst(warmUpPending_.front());
+		if(d.id() > 0)
+		{
+			data.push_back(d);
+		}
+		warmUpPending_.pop_front();
+	}
+
+	boost::mutex::scoped_lock lock(warmUpMutex_);
+	warmUpQueue_.splice(warmUpQueue_.end(), data);
+	if(warmUpPending_.empty())
+	{
+		warmUpAllQueued_ = true;
+		warmUpTimer_.stop();
+	}
+}
+
+void MapsManager::warmUpLoop()
+{
+#ifdef __linux__
+	// lowest priority for this thread only, sensor processing has precedence
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+
+	UTimer timer;
+	int count = 0;
+	bool canceled = false;
+	while(ros::ok())
+	{
+		std::list<rtabmap::SensorData> data;
+		bool last;
+		{
+			boost::mutex::scoped_lock lock(warmUpMutex_);
+			canceled = warmUpCanceled_;
+			data.swap(warmUpQueue_);
+			last = warmUpAllQueued_;
+		}
+		if(canceled)
+		{
+			break;
+		}
+		if(data.empty())
+		{
+			if(last)
+			{
+				break;
+			}
+			uSleep(10);
+			continue;
+		}
+
+		for(std::list<rtabmap::SensorData>::iterator iter=data.begin(); iter!=data.end(); ++iter)
+		{
+			bool rgbDepthRequired, depthRequired, scanRequired;
+			{
+				boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+				rgbDepthRequired = warmUpCloud_ && !uContains(clouds_, iter->id());
+				depthRequired = warmUpProj_ && !uContains(projMaps_, iter->id());
+				scanRequired = warmUpGrid_ && !uContains(gridMaps_, iter->id());
+			}
+			if(rgbDepthRequired || depthRequired || scanRequired)
+			{
+				createLocalMaps(*iter, rgbDepthRequired, depthRequired, scanRequired);
+				++count;
+			}
+		}
+	}
+	{
+		// the warmed caches can be cleaned up from now on (map_cleanup)
+		boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+		warmUpRunning_ = false;
+	}
+	ROS_INFO("Map caches warm-up %s: %d nodes processed (%fs)", canceled?"canceled":"done", count, timer.ticks());
+}
+
+// Nodes loaded from the memory (main thread) and written to the file (export thread)
+// at the same time. Not more than this number of nodes are waiting in memory.
+#define EXPORT_CHUNK_SIZE 10
+// Written voxels of this number of previous chunks are remembered
+// to drop duplicated points, so that the memory used stays bounded.
+#define EXPORT_DEDUP_CHUNKS 10
+
+int MapsManager::startExport(
+		const std::string & path,
+		const std::map<int, rtabmap::Transform> & poses,
+		const rtabmap::Memory * memory,
+		float voxelSize)
+{
+	if(isExporting())
+	{
+		ROS_ERROR("An export is already running!");
+		return -1;
+	}
+	stopExport(); // cleanup of the previous export
+	std::string ext = UFile::getExtension(path);
+	if(ext.compare("ply") != 0 && ext.compare("pcd") != 0)
+	{
+		ROS_ERROR("Export: file extension should be \"ply\" or \"pcd\" (%s)", path.c_str());
+		return -1;
+	}
+	if(!memory)
+	{
+		ROS_ERROR("Export: memory should not be null!");
+		return -1;
+	}
+
+	std::ofstream * file = new std::ofstream(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file->is_open())
+	{
+		ROS_ERROR("Export: cannot open \"%s\"", path.c_str());
+		delete file;
+		return -1;
+	}
+
+	// The number of points is unknown until the end, it is
+	// written with a fixed width and updated when done.
+	bool ply = ext.compare("ply") == 0;
+	if(ply)
+	{
+		*file << "ply\n"
+			  << "format binary_little_endian 1.0\n"
+			  << "element vertex " << uFormat("%012d", 0) << "\n"
+			  << "property float x\n"
+			  << "property float y\n"
+			  << "property float z\n"
+			  << "property uchar red\n"
+			  << "property uchar green\n"
+			  << "property uchar blue\n"
+			  << "end_header\n";
+	}
+	else
+	{
+		*file << "# .PCD v0.7 - Point Cloud Data file format\n"
+			  << "VERSION 0.7\n"
+			  << "FIELDS x y z rgb\n"
+			  << "SIZE 4 4 4 4\n"
+			  << "TYPE F F F F\n"
+			  << "COUNT 1 1 1 1\n"
+			  << "WIDTH " << uFormat("%012d", 0) << "\n"
+			  << "HEIGHT 1\n"
+			  << "VIEWPOINT 0 0 0 1 0 0 0\n"
+			  << "POINTS " << uFormat("%012d", 0) << "\n"
+			  << "DATA binary\n";
+	}
+
+	exportPending_.clear();
+	exportQueue_.clear();
+	for(std::map<int, Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		if(!iter->second.isNull())
+		{
+			exportPending_.push_back(*iter);
+		}
+	}
+	int total = (int)exportPending_.size();
+	ROS_INFO("Export: %d nodes to \"%s\"", total, path.c_str());
+
+	exportMemory_ = memory;
+	{
+		boost::mutex::scoped_lock lock(exportMutex_);
+		exportAllQueued_ = false;
+		exportCanceled_ = false;
+		exportFinished_ = false;
+	}
+	exportThread_ = new boost::thread(boost::bind(&MapsManager::exportLoop, this, file, ply, voxelSize>0.0f?voxelSize:cloudVoxelSize_, total));
+
+	// the memory is not thread-safe, nodes are loaded in the main thread
+	exportTimer_ = nh_.createTimer(ros::Duration(0.01), &MapsManager::exportTimerCallback, this);
+	return total;
+}
+
+void MapsManager::stopExport()
+{
+	exportTimer_.stop();
+	if(exportThread_)
+	{
+		{
+			boost::mutex::scoped_lock lock(exportMutex_);
+			exportCanceled_ = true;
+		}
+		exportThread_->join();
+		delete exportThread_;
+		exportThread_ = 0;
+	}
+	exportPending_.clear();
+	exportQueue_.clear();
+	exportMemory_ = 0;
+}
+
+bool MapsManager::isExporting() const
+{
+	boost::mutex::scoped_lock lock(exportMutex_);
+	return exportThread_ != 0 && !exportFinished_;
+}
+
+void MapsManager::exportTimerCallback(const ros::TimerEvent &)
+{
+	int queued;
+	{
+		boost::mutex::scoped_lock lock(exportMutex_);
+		if(!exportMemory_ || exportCanceled_)
+		{
+			exportTimer_.stop();
+			return;
+		}
+		queued = (int)exportQueue_.size();
+	}
+	std::list<ExportItem> items;
+	while(queued + (int)items.size() < EXPORT_CHUNK_SIZE && exportPending_.size())
+	{
+		ExportItem item;
+		item.pose = exportPending_.front().second;
+		{
+			boost::recursive_mutex::scoped_lock lock(cachesMutex_);
+			std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter = clouds_.find(exportPending_.front().first);
+			if(iter != clouds_.end())
+			{
+				item.cloud = iter->second;
+			}
+		}
+		if(!item.cloud.get())
+		{
+			item.data = exportMemory_->getSignatureDataConst(exportPending_.front().first);
+		}
+		items.push_back(item);
+		exportPending_.pop_front();
+	}
+
+	if(items.size() || exportPending_.empty())
+	{
+		boost::mutex::scoped_lock lock(exportMutex_);
+		exportQueue_.splice(exportQueue_.end(), items);
+		if(exportPending_.empty())
+		{
+			exportAllQueued_ = true;
+			exportTimer_.stop();
+		}
+	}
+}
+
+void MapsManager::exportLoop(std::ofstream * file, bool ply, float voxelSize, int total)
+{
+#ifdef __linux__
+	// lowest priority for this thread only, sensor processing has precedence
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+
+	UTimer timer;
+	int done = 0;
+	int points = 0;
+	// Voxels written by the last EXPORT_DEDUP_CHUNKS chunks: a chunk is
+	// voxelized alone, then its points in these voxels are dropped. Nodes
+	// are exported by id, so consecutive nodes overlapping the most are
+	// deduplicated. Points of places revisited later (loop closures) are
+	// still written again, at most once per visit.
+	std::deque<boost::unordered_set<unsigned long long> > writtenVoxels;
+	bool canceled = false;
+	while(ros::ok())
+	{
+		std::list<ExportItem> items;
+		bool last;
+		{
+			boost::mutex::scoped_lock lock(exportMutex_);
+			canceled = exportCanceled_;
+			items.swap(exportQueue_);
+			last = exportAllQueued_;
+		}
+		if(canceled)
+		{
+			break;
+		}
+		if(items.empty())
+		{
+			if(last)
+			{
+				break;
+			}
+			uSleep(10);
+			continue;
+		}
+
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr chunk(new pcl::PointCloud<pcl::PointXYZRGB>);
+		for(std::list<ExportItem>::iterator iter=items.begin(); iter!=items.end(); ++iter)
+		{
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = iter->cloud;
+			if(!cloud.get() &&
+			   !iter->data.imageCompressed().empty() &&
+			   !iter->data.depthOrRightCompressed().empty())
+			{
+				cv::Mat image, depth;
+				iter->data.uncompressData(&image, &depth, 0);
+				if(!image.empty() && !depth.empty())
+				{
+					cloud = util3d::cloudRGBFromSensorData(
+							iter->data,
+							cloudDecimation_,
+							cloudMaxDepth_,
+							cloudVoxelSize_);
+				}
+			}
+			if(cloud.get() && cloud->size())
+			{
+				*chunk += *util3d::transformPointCloud(cloud, iter->pose);
+			}
+		}
+		if(chunk->size() && voxelSize > 0.0f)
+		{
+			chunk = util3d::voxelize(chunk, voxelSize);
+		}
+
+		boost::unordered_set<unsigned long long> chunkVoxels;
+
+		for(unsigned int i=0; i<chunk->size(); ++i)
+		{
+			const pcl::PointXYZRGB & pt = chunk->at(i);
+			if(!pcl::isFinite(pt))
+			{
+				continue;
+			}
+			if(voxelSize > 0.0f)
+			{
+				// 21 bits per axis
+				unsigned long long key =
+						((unsigned long long)((int)std::floor(pt.x/voxelSize) + (1<<20)) & 0x1FFFFF) << 42 |
+						((unsigned long long)((int)std::floor(pt.y/voxelSize) + (1<<20)) & 0x1FFFFF) << 21 |
+						((unsigned long long)((int)std::floor(pt.z/voxelSize) + (1<<20)) & 0x1FFFFF);
+				bool written = false;
+				for(unsigned int j=0; j<writtenVoxels.size() && !written; ++j)
+				{
+					written = writtenVoxels[j].find(key) != writtenVoxels[j].end();
+				}
+				if(written)
+				{
+					continue; // already written by a previous chunk
+				}
+				chunkVoxels.insert(key);
+			}
+			file->write((const char *)&pt.x, sizeof(float));
+			file->write((const char *)&pt.y, sizeof(float));
+			file->write((const char *)&pt.z, sizeof(float));
+			if(ply)
+			{
+				file->write((const char *)&pt.r, 1);
+				file->write((const char *)&pt.g, 1);
+				file->write((const char *)&pt.b, 1);
+			}
+			else
+			{
+				file->write((const char *)&pt.rgb, sizeof(float));
+			}
+			++points;
+		}
+		if(voxelSize > 0.0f)
+		{
+			writtenVoxels.push_back(boost::unordered_set<unsigned long long>());
+			writtenVoxels.back().swap(chunkVoxels);
+			if(writtenVoxels.size() > EXPORT_DEDUP_CHUNKS)
+			{
+				writtenVoxels.pop_front();
+			}
+		}
+
+		done += (int)items.size();
+		ROS_INFO("Export: %d/%d nodes, %d points (%fs)", done, total, points, timer.elapsed());
+		std_msgs::Float32 progress;
+		progress.data = total>0?float(done)/float(total):1.0f;
+		exportProgressPub_.publish(progress);
+	}
+
+	// update the number of points in the header
+	std::string header = ply?
+			uFormat("ply\nformat binary_little_endian 1.0\nelement vertex %012d\n", points):
+			uFormat("# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\nFIELDS x y z rgb\nSIZE 4 4 4 4\nTYPE F F F F\nCOUNT 1 1 1 1\nWIDTH %012d\n", points);
+	file->seekp(0);
+	file->write(header.c_str(), header.size());
+	if(!ply)
+	{
+		std::string pointsLine = uFormat("HEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS %012d\n", points);
+		file->write(pointsLine.c_str(), pointsLine.size());
+	}
+	file->close();
+	delete file;
+
+	ROS_INFO("Export %s: %d/%d nodes, %d points (%fs)", canceled?"canceled":"done", done, total, points, timer.ticks());
+	boost::mutex::scoped_lock lock(exportMutex_);
+	exportFinished_ = true;
+}
+
 #ifdef WITH_OCTOMAP
 // returned OcTree must be deleted
 // RTAB-Map optimizes the graph at almost each iteration, an octomap cannot
@@ -552,6 +1237,7 @@ cv::Mat MapsManager::generateGridMap(
 //
 octomap::OcTree * MapsManager::createOctomap(const std::map<int, Transform> & poses)
 {
+	boost::recursive_mutex::scoped_lock lock(cachesMutex_);
 	octomap::OcTree * octree = new octomap::OcTree(gridCellSize_);
 	UTimer time;
 	for(std::map<int, Transform>::const_iterator posesIter = poses.begin(); posesIter!=poses.end(); ++posesIter)
@@ -586,7 +1272,7 @@ octomap::OcTree * MapsManager::createOctomap(const std::map<int, Transform> & po
 	ROS_INFO("updated inner occupancy (%fs)", time.ticks());
 
 	// clear memory if no one subscribed
-	if(mapCacheCleanup_ && cloudMapPub_.getNumSubscribers() == 0)
+	if(mapCacheCleanup_ && !(warmUpCloud_ && warmUpRunning_) && cloudMapPub_.getNumSubscribers() == 0)
 	{
 		clouds_.clear();
 	}
@@ -9,10 +9,18 @@
 #define MAPSMANAGER_H_
 
 #include <rtabmap/core/Signature.h>
+#include <rtabmap_ros/PosesGridIndex.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <ros/time.h>
 #include <ros/publisher.h>
+#include <ros/timer.h>
+#include <ros/node_handle.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <fstream>
 
 namespace octomap{
 class OcTree;
@@ -26,7 +34,9 @@ class Memory;
 
 class MapsManager {
 public:
-	MapsManager();
+	MapsManager(
+			const ros::NodeHandle & nh = ros::NodeHandle(),
+			const ros::NodeHandle & pnh = ros::NodeHandle("~"));
 	virtual ~MapsManager();
 	void clear();
 	bool hasSubscribers() const;
@@ -42,30 +52,93 @@ public:
 			bool updateGrid,
 			const std::map<int, rtabmap::Signature> & signatures = std::map<int, rtabmap::Signature>());
 
+	// Update caches only for the nodes in the region: the sphere of "radius"
+	// around "center" or, if radius<=0, the box of "boxHalfSize" around it.
+	// Return the filtered poses of the nodes in the region.
+	std::map<int, rtabmap::Transform> updateRegionMapCaches(
+			const std::map<int, rtabmap::Transform> & poses,
+			const rtabmap::Memory * memory,
+			const rtabmap::Transform & center,
+			float radius,
+			const cv::Point3f & boxHalfSize,
+			bool updateCloud,
+			bool updateProj,
+			bool updateGrid);
+
 	void publishMaps(
 			const std::map<int, rtabmap::Transform> & poses,
 			const ros::Time & stamp,
 			const std::string & mapFrameId);
 
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembleCloudMap(
+			const std::map<int, rtabmap::Transform> & poses);
+
 	cv::Mat generateProjMap(
 			const std::map<int, rtabmap::Transform> & filteredPoses,
 			float & xMin,
 			float & yMin,
 			float & gridCellSize);
 
+	// Unknown space is filled with the laser scan parameters around
+	// "currentPose" (last pose of "filteredPoses" if null), if in the map
 	cv::Mat generateGridMap(
 			const std::map<int, rtabmap::Transform> & filteredPoses,
 			float & xMin,
 			float & yMin,
-			float & gridCellSize);
+			float & gridCellSize,
+			const rtabmap::Transform & currentPose = rtabmap::Transform());
 
 	void setLaserScanParameters(float maxRange, float minAngle, float maxAngle, float increment);
 
+	// Background warm-up of the map caches (see map_warm_up_* parameters)
+	bool isWarmUpEnabled() const {return warmUpCloud_ || warmUpProj_ || warmUpGrid_;}
+	void startWarmUp(
+			const std::map<int, rtabmap::Transform> & poses,
+			const rtabmap::Memory * memory);
+	void stopWarmUp();
+
+	// Streaming export of the cloud map to a PLY/PCD file (see ExportMap service)
+	bool isExporting() const;
+	int startExport(
+			const std::string & path,
+			const std::map<int, rtabmap::Transform> & poses,
+			const rtabmap::Memory * memory,
+			float voxelSize);
+	void stopExport();
+
 #ifdef WITH_OCTOMAP
 	octomap::OcTree * createOctomap(const std::map<int, rtabmap::Transform> & poses);
 #endif
 
 private:
+	void fillMapCaches(
+			const std::map<int, rtabmap::Transform> & filteredPoses,
+			const rtabmap::Memory * memory,
+			bool updateCloud,
+			bool updateProj,
+			bool updateGrid,
+			double timeBudget,
+			const std::map<int, rtabmap::Signature> & signatures = std::map<int, rtabmap::Signature>());
+	void createLocalMaps(
+			rtabmap::SensorData & data,
+			bool rgbDepthRequired,
+			bool depthRequired,
+			bool scanRequired);
+	void warmUpTimerCallback(const ros::TimerEvent &);
+	void warmUpLoop();
+
+	struct ExportItem
+	{
+		rtabmap::Transform pose;
+		rtabmap::SensorData data; // used if cloud is null
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+	};
+	void exportTimerCallback(const ros::TimerEvent &);
+	void exportLoop(std::ofstream * file, bool ply, float voxelSize, int total);
+
+private:
+	ros::NodeHandle nh_;
+
 	// mapping stuff
 	int cloudDecimation_;
 	double cloudMaxDepth_;
@@ -80,19 +153,50 @@ private:
 	double mapFilterRadius_;
 	double mapFilterAngle_;
 	bool mapCacheCleanup_;
+	double mapUpdateTimeBudget_;
+	bool warmUpCloud_;
+	bool warmUpProj_;
+	bool warmUpGrid_;
 
 	float laserScanMaxRange_;
 	float laserScanMinAngle_;
 	float laserScanMaxAngle_;
 	float laserScanIncrement_;
 
+	// One index per set of poses, so that each one is updated incrementally
+	rtabmap_ros::PosesGridIndex localPosesIndex_;   // local graph (map updates, region requests, warm-up)
+	rtabmap_ros::PosesGridIndex requestPosesIndex_; // graphs of the service requests (e.g. global map)
+
 	ros::Publisher cloudMapPub_;
 	ros::Publisher projMapPub_;
 	ros::Publisher gridMapPub_;
+	ros::Publisher mapCompletenessPub_;
 
 	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr > clouds_;
 	std::map<int, std::pair<cv::Mat, cv::Mat> > projMaps_; // <ground, obstacles>
 	std::map<int, std::pair<cv::Mat, cv::Mat> > gridMaps_; // <ground, obstacles>
+	boost::recursive_mutex cachesMutex_;
+
+	bool warmUpRunning_; // warmed caches are not cleaned up while true (cachesMutex_)
+	ros::Timer warmUpTimer_;
+	const rtabmap::Memory * warmUpMemory_;
+	std::list<int> warmUpPending_; // not loaded yet, closest nodes first
+	std::list<rtabmap::SensorData> warmUpQueue_; // loaded, waiting to be processed
+	boost::mutex warmUpMutex_; // warmUpQueue_, warmUpAllQueued_ and warmUpCanceled_
+	boost::thread * warmUpThread_;
+	bool warmUpAllQueued_;
+	bool warmUpCanceled_;
+
+	ros::Publisher exportProgressPub_;
+	ros::Timer exportTimer_;
+	const rtabmap::Memory * exportMemory_;
+	std::list<std::pair<int, rtabmap::Transform> > exportPending_; // not loaded yet
+	std::list<ExportItem> exportQueue_; // loaded, waiting to be written
+	mutable boost::mutex exportMutex_; // exportQueue_ and the export flags
+	boost::thread * exportThread_;
+	bool exportAllQueued_;
+	bool exportCanceled_;
+	bool exportFinished_;
 };
 
 #endif /* MAPSMANAGER_H_ */
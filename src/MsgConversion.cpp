@@ -28,6 +28,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_ros/MsgConversion.h"
 
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <sensor_msgs/image_encodings.h>
 #include <zlib.h>
 #include <ros/ros.h>
 #include <rtabmap/core/util3d.h>
@@ -35,6 +37,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl_conversions/pcl_conversions.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <tf_conversions/tf_eigen.h>
+#include <boost/thread/mutex.hpp>
+
+#define CONVERSION_CACHE_SIZE 8
 
 namespace rtabmap_ros {
 
@@ -616,4 +621,115 @@ void odomInfoToROS(const rtabmap::OdometryInfo & info, rtabmap_ros::OdomInfo & m
 
 }
 
+// Conversions of the last image messages, an entry is valid
+// as long as its message is still referenced somewhere. As messages
+// can be reused by their publisher (see imageMsgBuffer()), the header
+// and the data of the message are also compared.
+struct CachedConversion
+{
+	boost::weak_ptr<const sensor_msgs::Image> msg;
+	ros::Time stamp;
+	unsigned int seq;
+	const unsigned char * data;
+	std::string encoding;
+	cv_bridge::CvImageConstPtr image;
+};
+
+static bool sameConversion(const CachedConversion & conversion, const sensor_msgs::Image & msg, const std::string & encoding)
+{
+	return conversion.stamp == msg.header.stamp &&
+		   conversion.seq == msg.header.seq &&
+		   conversion.data == (msg.data.size()?&msg.data[0]:0) &&
+		   conversion.encoding.compare(encoding) == 0;
+}
+static std::list<CachedConversion> conversionCache;
+static boost::mutex conversionCacheMutex;
+
+cv_bridge::CvImageConstPtr toCvShareCached(const sensor_msgs::ImageConstPtr & msg, const std::string & encoding)
+{
+	if(encoding.empty() || encoding.compare(msg->encoding) == 0)
+	{
+		// no conversion, the data is shared with the message
+		return cv_bridge::toCvShare(msg, encoding);
+	}
+
+	bool toMono = encoding.compare(sensor_msgs::image_encodings::MONO8) == 0;
+	cv_bridge::CvImageConstPtr bgr;
+	{
+		boost::mutex::scoped_lock lock(conversionCacheMutex);
+		for(std::list<CachedConversion>::iterator iter=conversionCache.begin(); iter!=conversionCache.end();)
+		{
+			sensor_msgs::ImageConstPtr cachedMsg = iter->msg.lock();
+			if(!cachedMsg.get())
+			{
+				conversionCache.erase(iter++);
+			}
+			else
+			{
+				if(cachedMsg == msg && sameConversion(*iter, *msg, encoding))
+				{
+					return iter->image;
+				}
+				if(toMono && cachedMsg == msg && sameConversion(*iter, *msg, sensor_msgs::image_encodings::BGR8))
+				{
+					bgr = iter->image;
+				}
+				++iter;
+			}
+		}
+	}
+
+	// convert outside the lock (cvtColor)
+	cv_bridge::CvImageConstPtr image;
+	if(bgr.get())
+	{
+		// Odometry wants mono8 and rtabmap bgr8: when the bgr8 conversion
+		// (e.g. from rgb8 or bayer) is already done, derive the grayscale from it.
+		cv_bridge::CvImagePtr mono(new cv_bridge::CvImage(msg->header, encoding));
+		cv::cvtColor(bgr->image, mono->image, CV_BGR2GRAY);
+		image = mono;
+	}
+	else
+	{
+		image = cv_bridge::toCvShare(msg, encoding);
+	}
+
+	boost::mutex::scoped_lock lock(conversionCacheMutex);
+	CachedConversion conversion;
+	conversion.msg = msg;
+	conversion.stamp = msg->header.stamp;
+	conversion.seq = msg->header.seq;
+	conversion.data = msg->data.size()?&msg->data[0]:0;
+	conversion.encoding = encoding;
+	conversion.image = image;
+	conversionCache.push_back(conversion);
+	if(conversionCache.size() > CONVERSION_CACHE_SIZE)
+	{
+		conversionCache.pop_front();
+	}
+	return image;
+}
+
+cv::Mat imageMsgBuffer(
+		sensor_msgs::ImagePtr & msg,
+		const std_msgs::Header & header,
+		int rows,
+		int cols,
+		int type,
+		const std::string & encoding)
+{
+	if(!msg.get() || !msg.unique())
+	{
+		msg.reset(new sensor_msgs::Image);
+	}
+	msg->header = header;
+	msg->height = rows;
+	msg->width = cols;
+	msg->encoding = encoding;
+	msg->is_bigendian = false;
+	msg->step = cols * CV_ELEM_SIZE(type);
+	msg->data.resize(msg->step * rows);
+	return cv::Mat(rows, cols, type, msg->data.size()?&msg->data[0]:0);
+}
+
 }
@@ -25,16 +25,18 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-#include "OdometryROS.h"
+#include "rtabmap_ros/OdometryROS.h"
 
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
 #include <nav_msgs/Odometry.h>
 
 #include <pcl_conversions/pcl_conversions.h>
 
 #include <cv_bridge/cv_bridge.h>
+#include <opencv2/imgproc/imgproc.hpp>
 
 #include <rtabmap/core/Odometry.h>
 #include <rtabmap/core/util3d_transforms.h>
@@ -42,33 +44,82 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/Signature.h>
 #include "rtabmap_ros/MsgConversion.h"
 #include "rtabmap_ros/OdomInfo.h"
+#include "rtabmap_ros/OdomStatistics.h"
 #include "rtabmap/utilite/UConversion.h"
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UStl.h"
 
+#define LOCAL_TRANSFORM_STATIC_COUNT 5 // identical lookups before caching
+#define STATISTICS_WINDOW 300 // frames
+
 using namespace rtabmap;
 
 namespace rtabmap_ros {
 
-OdometryROS::OdometryROS(int argc, char * argv[]) :
+OdometryROS::OdometryROS() :
 	odometry_(0),
 	frameId_("base_link"),
 	odomFrameId_("odom"),
 	groundTruthFrameId_(""),
 	publishTf_(true),
 	waitForTransform_(true),
-	paused_(false)
+	pipelined_(false),
+	staticLocalTransform_(true),
+	localMapDeltaDecimation_(1),
+	statisticsPeriod_(1.0),
+	skipThreshold_(0.0),
+	skipMaxFrames_(5),
+	resetSeed_(false),
+	paused_(false),
+	skipCount_(0),
+	lastVariance_(0.0f),
+	statsReceived_(0),
+	statsConverted_(0),
+	statsDroppedPipeline_(0),
+	statsSkipped_(0),
+	statsProcessed_(0),
+	statsLost_(0),
+	pipelineThread_(0),
+	pipelineStop_(false),
+	pipelineHasData_(false),
+	pipelineDropped_(0)
+{
+}
+
+OdometryROS::~OdometryROS()
 {
-	this->processArguments(argc, argv);
+	if(pipelineThread_)
+	{
+		{
+			boost::mutex::scoped_lock lock(pipelineMutex_);
+			pipelineStop_ = true;
+		}
+		pipelineCondition_.notify_one();
+		pipelineThread_->join();
+		delete pipelineThread_;
+	}
+
+	ros::NodeHandle & pnh = getPrivateNodeHandle();
+	for(ParametersMap::iterator iter=parameters_.begin(); iter!=parameters_.end(); ++iter)
+	{
+		pnh.deleteParam(iter->first);
+	}
+
+	delete odometry_;
+}
 
-	ros::NodeHandle nh;
+void OdometryROS::onInit()
+{
+	ros::NodeHandle & nh = getNodeHandle();
 
 	odomPub_ = nh.advertise<nav_msgs::Odometry>("odom", 1);
 	odomInfoPub_ = nh.advertise<rtabmap_ros::OdomInfo>("odom_info", 1);
-	odomLocalMap_ = nh.advertise<sensor_msgs::PointCloud2>("odom_local_map", 1);
+	odomLocalMap_ = nh.advertise<sensor_msgs::PointCloud2>("odom_local_map", 1, true); // latched, published only on changes
+	odomLocalMapDelta_ = nh.advertise<sensor_msgs::PointCloud2>("odom_local_map_delta", 1); // new points only
 	odomLastFrame_ = nh.advertise<sensor_msgs::PointCloud2>("odom_last_frame", 1);
+	odomStatisticsPub_ = nh.advertise<rtabmap_ros::OdomStatistics>("odom_statistics", 1);
 
-	ros::NodeHandle pnh("~");
+	ros::NodeHandle & pnh = getPrivateNodeHandle();
 
 	Transform initialPose = Transform::getIdentity();
 	std::string initialPoseStr;
@@ -80,6 +131,17 @@ OdometryROS::OdometryROS(int argc, char * argv[]) :
 	pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
 	pnh.param("initial_pose", initialPoseStr, initialPoseStr); // "x y z roll pitch yaw"
 	pnh.param("ground_truth_frame_id", groundTruthFrameId_, groundTruthFrameId_);
+	pnh.param("pipelined", pipelined_, pipelined_); // motion estimation in its own thread
+	pnh.param("static_local_transform", staticLocalTransform_, staticLocalTransform_);
+	pnh.param("local_map_delta_decimation", localMapDeltaDecimation_, localMapDeltaDecimation_);
+	if(localMapDeltaDecimation_ < 1)
+	{
+		localMapDeltaDecimation_ = 1;
+	}
+	pnh.param("statistics_period", statisticsPeriod_, statisticsPeriod_); // s, 0=disabled
+	pnh.param("skip_threshold", skipThreshold_, skipThreshold_); // mean intensity difference, 0=disabled
+	pnh.param("skip_max_frames", skipMaxFrames_, skipMaxFrames_);
+	pnh.param("reset_seed", resetSeed_, resetSeed_); // on reset, seed the local map with the last frame
 
 	if(!tfPrefix.empty())
 	{
@@ -242,17 +304,25 @@ OdometryROS::OdometryROS(int argc, char * argv[]) :
 	resetToPoseSrv_ = nh.advertiseService("reset_odom_to_pose", &OdometryROS::resetToPose, this);
 	pauseSrv_ = nh.advertiseService("pause_odom", &OdometryROS::pause, this);
 	resumeSrv_ = nh.advertiseService("resume_odom", &OdometryROS::resume, this);
-}
 
-OdometryROS::~OdometryROS()
-{
-	ros::NodeHandle pnh("~");
-	for(ParametersMap::iterator iter=parameters_.begin(); iter!=parameters_.end(); ++iter)
+	if(staticLocalTransform_)
 	{
-		pnh.deleteParam(iter->first);
+		localTransformsTimer_ = nh.createTimer(ros::Duration(1.0), &OdometryROS::localTransformsTimerCallback, this);
 	}
 
-	delete odometry_;
+	if(statisticsPeriod_ > 0.0)
+	{
+		statsLastTime_ = ros::WallTime::now();
+		statisticsTimer_ = nh.createWallTimer(ros::WallDuration(statisticsPeriod_), &OdometryROS::statisticsTimerCallback, this);
+	}
+
+	if(pipelined_)
+	{
+		ROS_INFO("Odometry pipelined: motion estimation done in its own thread");
+		pipelineThread_ = new boost::thread(boost::bind(&OdometryROS::pipelineLoop, this));
+	}
+
+	onOdomInit();
 }
 
 void OdometryROS::processArguments(int argc, char * argv[])
@@ -302,8 +372,420 @@ void OdometryROS::processArguments(int argc, char * argv[])
 	}
 }
 
-void OdometryROS::processData(const SensorData & data, const ros::Time & stamp)
+// Compare two local maps (both sorted by word id), points of "current" not
+// in "previous" are added to "newPoints" if not null.
+static bool localMapChanged(
+		const std::map<int, pcl::PointXYZ> & previous,
+		const std::map<int, pcl::PointXYZ> & current,
+		std::vector<pcl::PointXYZ> * newPoints)
+{
+	bool changed = previous.size() != current.size();
+	std::map<int, pcl::PointXYZ>::const_iterator jter=previous.begin();
+	for(std::map<int, pcl::PointXYZ>::const_iterator iter=current.begin(); iter!=current.end(); ++iter)
+	{
+		while(jter!=previous.end() && jter->first < iter->first)
+		{
+			++jter;
+		}
+		if(jter!=previous.end() && jter->first == iter->first)
+		{
+			if(jter->second.x != iter->second.x ||
+			   jter->second.y != iter->second.y ||
+			   jter->second.z != iter->second.z)
+			{
+				changed = true;
+			}
+			++jter;
+		}
+		else
+		{
+			changed = true;
+			if(newPoints)
+			{
+				newPoints->push_back(iter->second);
+			}
+		}
+	}
+	return changed;
+}
+
+// Setup an unorganized xyz cloud of "size" points, filled by the caller
+static void initXYZCloudMsg(size_t size, sensor_msgs::PointCloud2 & msg)
+{
+	sensor_msgs::PointCloud2Modifier modifier(msg);
+	modifier.setPointCloud2FieldsByString(1, "xyz");
+	modifier.resize(size);
+	msg.is_dense = true;
+}
+
+static bool sameTransform(const Transform & a, const Transform & b)
+{
+	float x,y,z,roll,pitch,yaw;
+	(a.inverse()*b).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+	return fabs(x) < 0.0001f && fabs(y) < 0.0001f && fabs(z) < 0.0001f &&
+		   fabs(roll) < 0.0001f && fabs(pitch) < 0.0001f && fabs(yaw) < 0.0001f;
+}
+
+Transform OdometryROS::getLocalTransform(const std::string & sensorFrameId, const ros::Time & stamp)
+{
+	if(staticLocalTransform_)
+	{
+		boost::mutex::scoped_lock lock(localTransformsMutex_);
+		std::map<std::string, Transform>::iterator iter = localTransforms_.find(sensorFrameId);
+		if(iter != localTransforms_.end())
+		{
+			return iter->second;
+		}
+	}
+
+	Transform localTransform;
+	try
+	{
+		if(waitForTransform_)
+		{
+			if(!tfListener_.waitForTransform(frameId_, sensorFrameId, stamp, ros::Duration(1)))
+			{
+				ROS_WARN("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), sensorFrameId.c_str());
+				return localTransform;
+			}
+		}
+		tf::StampedTransform tmp;
+		tfListener_.lookupTransform(frameId_, sensorFrameId, stamp, tmp);
+		localTransform = rtabmap_ros::transformFromTF(tmp);
+	}
+	catch(tf::TransformException & ex)
+	{
+		ROS_WARN("%s",ex.what());
+		return localTransform;
+	}
+
+	if(staticLocalTransform_)
+	{
+		boost::mutex::scoped_lock lock(localTransformsMutex_);
+		std::pair<Transform, int> & pending = localTransformsPending_[sensorFrameId];
+		if(!pending.first.isNull() && sameTransform(pending.first, localTransform))
+		{
+			++pending.second;
+		}
+		else
+		{
+			pending = std::make_pair(localTransform, 1);
+		}
+		if(pending.second >= LOCAL_TRANSFORM_STATIC_COUNT)
+		{
+			ROS_INFO("Odom: transform from %s to %s is static, it is now cached", frameId_.c_str(), sensorFrameId.c_str());
+			localTransforms_.insert(std::make_pair(sensorFrameId, localTransform));
+			localTransformsPending_.erase(sensorFrameId);
+		}
+	}
+	return localTransform;
+}
+
+void OdometryROS::localTransformsTimerCallback(const ros::TimerEvent &)
+{
+	std::list<std::string> frames;
+	{
+		boost::mutex::scoped_lock lock(localTransformsMutex_);
+		frames = uKeysList(localTransforms_);
+	}
+
+	for(std::list<std::string>::iterator iter=frames.begin(); iter!=frames.end(); ++iter)
+	{
+		// only the latest transform is checked, never wait for it
+		if(!tfListener_.canTransform(frameId_, *iter, ros::Time(0)))
+		{
+			continue;
+		}
+		Transform latest;
+		try
+		{
+			tf::StampedTransform tmp;
+			tfListener_.lookupTransform(frameId_, *iter, ros::Time(0), tmp);
+			latest = rtabmap_ros::transformFromTF(tmp);
+		}
+		catch(tf::TransformException & ex)
+		{
+			continue;
+		}
+
+		boost::mutex::scoped_lock lock(localTransformsMutex_);
+		std::map<std::string, Transform>::iterator jter = localTransforms_.find(*iter);
+		if(jter != localTransforms_.end() && !sameTransform(jter->second, latest))
+		{
+			// not static anymore, looked up again on each frame until it is stable
+			ROS_WARN("Odom: transform from %s to %s has changed, it is not cached anymore", frameId_.c_str(), iter->c_str());
+			localTransforms_.erase(jter);
+		}
+	}
+}
+
+static void addSample(std::deque<float> & window, float value)
+{
+	window.push_back(value);
+	if(window.size() > STATISTICS_WINDOW)
+	{
+		window.pop_front();
+	}
+}
+
+// 50th, 90th, 99th percentiles and maximum
+static void percentiles(const std::deque<float> & window, boost::array<float, 4> & values)
+{
+	if(window.empty())
+	{
+		values.assign(0.0f);
+		return;
+	}
+	std::vector<float> sorted(window.begin(), window.end());
+	std::sort(sorted.begin(), sorted.end());
+	values[0] = sorted[(sorted.size()-1)*50/100];
+	values[1] = sorted[(sorted.size()-1)*90/100];
+	values[2] = sorted[(sorted.size()-1)*99/100];
+	values[3] = sorted.back();
+}
+
+void OdometryROS::statisticsTimerCallback(const ros::WallTimerEvent &)
+{
+	rtabmap_ros::OdomStatistics msg;
+	{
+		boost::mutex::scoped_lock lock(statisticsMutex_);
+		ros::WallTime now = ros::WallTime::now();
+		double elapsed = (now - statsLastTime_).toSec();
+		if(odomStatisticsPub_.getNumSubscribers())
+		{
+			percentiles(statsLatency_, msg.latency);
+			percentiles(statsTimeConversion_, msg.timeConversion);
+			percentiles(statsTimePipeline_, msg.timePipeline);
+			percentiles(statsTimeEstimation_, msg.timeEstimation);
+			percentiles(statsTimePublish_, msg.timePublish);
+			msg.received = statsReceived_;
+			msg.converted = statsConverted_;
+			msg.droppedPipeline = statsDroppedPipeline_;
+			msg.skipped = statsSkipped_;
+			msg.processed = statsProcessed_;
+			msg.lost = statsLost_;
+			msg.rate = elapsed>0.0?float(statsProcessed_)/elapsed:0.0f;
+		}
+		statsReceived_ = 0;
+		statsConverted_ = 0;
+		statsDroppedPipeline_ = 0;
+		statsSkipped_ = 0;
+		statsProcessed_ = 0;
+		statsLost_ = 0;
+		statsLastTime_ = now;
+	}
+
+	if(odomStatisticsPub_.getNumSubscribers())
+	{
+		msg.header.stamp = ros::Time::now();
+		msg.header.frame_id = odomFrameId_;
+		odomStatisticsPub_.publish(msg);
+	}
+}
+
+// Compare a small grayscale version of the image with the one of the last
+// processed frame (mean absolute difference), so that frames of a static
+// camera are not processed, up to "skip_max_frames" frames in a row.
+bool OdometryROS::skipFrame(const SensorData & data)
+{
+	if(data.imageRaw().empty())
+	{
+		return false;
+	}
+
+	cv::Mat thumbnail;
+	int width = 80;
+	int height = std::max(1, data.imageRaw().rows * width / data.imageRaw().cols);
+	cv::resize(data.imageRaw(), thumbnail, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+	if(thumbnail.channels() == 3)
+	{
+		cv::cvtColor(thumbnail, thumbnail, CV_BGR2GRAY);
+	}
+
+	bool lost;
+	{
+		boost::mutex::scoped_lock lock(lastPoseMutex_);
+		lost = lastPose_.isNull();
+	}
+
+	if(!lost &&
+	   skipCount_ < skipMaxFrames_ &&
+	   skipThumbnail_.size() == thumbnail.size() &&
+	   skipThumbnail_.type() == thumbnail.type() &&
+	   cv::norm(skipThumbnail_, thumbnail, cv::NORM_L1) / double(thumbnail.total()) < skipThreshold_)
+	{
+		++skipCount_;
+		return true;
+	}
+
+	skipThumbnail_ = thumbnail;
+	skipCount_ = 0;
+	return false;
+}
+
+void OdometryROS::resetSkipping()
+{
+	skipThumbnail_ = cv::Mat();
+	skipCount_ = 0;
+	boost::mutex::scoped_lock lock(lastPoseMutex_);
+	lastPose_ = Transform();
+}
+
+// Without conversion, the raw images of the data point in the buffers of the
+// received messages, which can be freed or refilled (see imageMsgBuffer())
+// once the callback returns. Data kept after the callback should be a copy.
+static SensorData deepCopy(const SensorData & data)
+{
+	SensorData copy = data;
+	copy.setImageRaw(data.imageRaw().clone());
+	copy.setDepthOrRightRaw(data.depthOrRightRaw().clone());
+	return copy;
+}
+
+void OdometryROS::processData(const SensorData & data, const ros::Time & stamp, const ros::WallTime & timeSynchronized)
+{
+	{
+		boost::mutex::scoped_lock lock(statisticsMutex_);
+		++statsConverted_;
+		if(!timeSynchronized.isZero())
+		{
+			addSample(statsTimeConversion_, (ros::WallTime::now() - timeSynchronized).toSec());
+		}
+	}
+
+	if(skipThreshold_ > 0.0 && skipFrame(data))
+	{
+		// The image didn't change: the camera didn't move, republish the last
+		// pose. An older frame may still be waiting or in motion estimation
+		// (pipelined mode): to keep odometry in stamp order, the pose is
+		// republished only if none is (odometryMutex_ held meanwhile),
+		// otherwise the frame is processed as usual.
+		boost::mutex::scoped_lock lockOdom(odometryMutex_, boost::try_to_lock);
+		bool idle = lockOdom.owns_lock();
+		if(idle && pipelineThread_)
+		{
+			boost::mutex::scoped_lock lock(pipelineMutex_);
+			idle = !pipelineHasData_;
+		}
+		if(idle)
+		{
+			Transform pose;
+			float variance;
+			{
+				boost::mutex::scoped_lock lock(lastPoseMutex_);
+				pose = lastPose_;
+				variance = lastVariance_;
+			}
+			publishOdom(pose, stamp, variance);
+			boost::mutex::scoped_lock lock(statisticsMutex_);
+			++statsSkipped_;
+			return;
+		}
+	}
+
+	if(pipelineThread_)
+	{
+		// Single slot: if the motion estimation is still busy with the
+		// previous frame, the waiting frame is replaced by this one.
+		{
+			boost::mutex::scoped_lock lock(pipelineMutex_);
+			if(pipelineHasData_)
+			{
+				++pipelineDropped_;
+				boost::mutex::scoped_lock lockStats(statisticsMutex_);
+				++statsDroppedPipeline_;
+			}
+			pipelineData_ = deepCopy(data); // processed after the callback returned
+			pipelineStamp_ = stamp;
+			pipelineTime_ = ros::WallTime::now();
+			pipelineHasData_ = true;
+		}
+		pipelineCondition_.notify_one();
+	}
+	else
+	{
+		estimateMotion(data, stamp, 0.0);
+	}
+}
+
+void OdometryROS::pipelineLoop()
+{
+	while(true)
+	{
+		SensorData data;
+		ros::Time stamp;
+		double timePipeline = 0.0;
+		int dropped = 0;
+		{
+			boost::mutex::scoped_lock lock(pipelineMutex_);
+			while(!pipelineHasData_ && !pipelineStop_)
+			{
+				pipelineCondition_.wait(lock);
+			}
+			if(pipelineStop_)
+			{
+				break;
+			}
+			data = pipelineData_;
+			stamp = pipelineStamp_;
+			timePipeline = (ros::WallTime::now() - pipelineTime_).toSec();
+			dropped = pipelineDropped_;
+			pipelineData_ = SensorData();
+			pipelineHasData_ = false;
+			pipelineDropped_ = 0;
+		}
+		if(dropped)
+		{
+			ROS_WARN("Odom: %d frame(s) dropped, motion estimation is slower than the input rate", dropped);
+		}
+		estimateMotion(data, stamp, timePipeline);
+	}
+}
+
+void OdometryROS::publishOdom(const Transform & pose, const ros::Time & stamp, float variance)
 {
+	geometry_msgs::TransformStamped poseMsg;
+	poseMsg.child_frame_id = frameId_;
+	poseMsg.header.frame_id = odomFrameId_;
+	poseMsg.header.stamp = stamp;
+	rtabmap_ros::transformToGeometryMsg(pose, poseMsg.transform);
+
+	if(publishTf_)
+	{
+		tfBroadcaster_.sendTransform(poseMsg);
+	}
+
+	if(odomPub_.getNumSubscribers())
+	{
+		//next, we'll publish the odometry message over ROS
+		nav_msgs::Odometry odom;
+		odom.header.stamp = stamp; // use corresponding time stamp to image
+		odom.header.frame_id = odomFrameId_;
+		odom.child_frame_id = frameId_;
+
+		//set the position
+		odom.pose.pose.position.x = poseMsg.transform.translation.x;
+		odom.pose.pose.position.y = poseMsg.transform.translation.y;
+		odom.pose.pose.position.z = poseMsg.transform.translation.z;
+		odom.pose.pose.orientation = poseMsg.transform.rotation;
+
+		//set covariance
+		odom.pose.covariance.at(0) = variance;  // xx
+		odom.pose.covariance.at(7) = variance;  // yy
+		odom.pose.covariance.at(14) = variance; // zz
+		odom.pose.covariance.at(21) = variance; // rr
+		odom.pose.covariance.at(28) = variance; // pp
+		odom.pose.covariance.at(35) = variance; // yawyaw
+
+		//publish the message
+		odomPub_.publish(odom);
+	}
+}
+
+void OdometryROS::estimateMotion(const SensorData & data, const ros::Time & stamp, double timePipeline)
+{
+	boost::mutex::scoped_lock lock(odometryMutex_);
+
 	if(odometry_->getPose().isNull() &&
 	   !groundTruthFrameId_.empty())
 	{
@@ -337,61 +819,78 @@ void OdometryROS::processData(const SensorData & data, const ros::Time & stamp)
 	ros::WallTime time = ros::WallTime::now();
 	rtabmap::OdometryInfo info;
 	rtabmap::Transform pose = odometry_->process(data, &info);
+	if(resetSeed_)
+	{
+		// kept until the next reset, long after the messages are released
+		// (frames of the pipeline thread are already copies)
+		lastData_ = pipelineThread_?data:deepCopy(data);
+	}
+	ros::WallTime timeEstimated = ros::WallTime::now();
+	{
+		boost::mutex::scoped_lock lock(lastPoseMutex_);
+		lastPose_ = pose;
+		lastVariance_ = info.variance;
+	}
 	if(!pose.isNull())
 	{
 		//*********************
 		// Update odometry
 		//*********************
-		geometry_msgs::TransformStamped poseMsg;
-		poseMsg.child_frame_id = frameId_;
-		poseMsg.header.frame_id = odomFrameId_;
-		poseMsg.header.stamp = stamp;
-		rtabmap_ros::transformToGeometryMsg(pose, poseMsg.transform);
+		publishOdom(pose, stamp, info.variance);
 
-		if(publishTf_)
+		if(dynamic_cast<OdometryBOW*>(odometry_))
 		{
-			tfBroadcaster_.sendTransform(poseMsg);
-		}
-
-		if(odomPub_.getNumSubscribers())
-		{
-			//next, we'll publish the odometry message over ROS
-			nav_msgs::Odometry odom;
-			odom.header.stamp = stamp; // use corresponding time stamp to image
-			odom.header.frame_id = odomFrameId_;
-			odom.child_frame_id = frameId_;
-
-			//set the position
-			odom.pose.pose.position.x = poseMsg.transform.translation.x;
-			odom.pose.pose.position.y = poseMsg.transform.translation.y;
-			odom.pose.pose.position.z = poseMsg.transform.translation.z;
-			odom.pose.pose.orientation = poseMsg.transform.rotation;
+			const std::map<int, pcl::PointXYZ> & map = ((OdometryBOW*)odometry_)->getLocalMap();
 
-			//set covariance
-			odom.pose.covariance.at(0) = info.variance;  // xx
-			odom.pose.covariance.at(7) = info.variance;  // yy
-			odom.pose.covariance.at(14) = info.variance; // zz
-			odom.pose.covariance.at(21) = info.variance; // rr
-			odom.pose.covariance.at(28) = info.variance; // pp
-			odom.pose.covariance.at(35) = info.variance; // yawyaw
+			// each topic is compared with what was last published on it
+			if(odomLocalMap_.getNumSubscribers() && localMapChanged(localMap_, map, 0))
+			{
+				localMap_ = map;
 
-			//publish the message
-			odomPub_.publish(odom);
-		}
+				sensor_msgs::PointCloud2 cloudMsg;
+				initXYZCloudMsg(map.size(), cloudMsg);
+				sensor_msgs::PointCloud2Iterator<float> iterX(cloudMsg, "x");
+				sensor_msgs::PointCloud2Iterator<float> iterY(cloudMsg, "y");
+				sensor_msgs::PointCloud2Iterator<float> iterZ(cloudMsg, "z");
+				for(std::map<int, pcl::PointXYZ>::const_iterator iter=map.begin(); iter!=map.end(); ++iter, ++iterX, ++iterY, ++iterZ)
+				{
+					*iterX = iter->second.x;
+					*iterY = iter->second.y;
+					*iterZ = iter->second.z;
+				}
+				cloudMsg.header.stamp = stamp; // use corresponding time stamp to image
+				cloudMsg.header.frame_id = odomFrameId_;
+				odomLocalMap_.publish(cloudMsg);
+			}
 
-		if(odomLocalMap_.getNumSubscribers() && dynamic_cast<OdometryBOW*>(odometry_))
-		{
-			const std::map<int, pcl::PointXYZ> & map = ((OdometryBOW*)odometry_)->getLocalMap();
-			pcl::PointCloud<pcl::PointXYZ> cloud;
-			for(std::map<int, pcl::PointXYZ>::const_iterator iter=map.begin(); iter!=map.end(); ++iter)
+			if(odomLocalMapDelta_.getNumSubscribers())
+			{
+				std::vector<pcl::PointXYZ> newPoints;
+				localMapChanged(localMapDelta_, map, &newPoints);
+				localMapDelta_ = map;
+				if(newPoints.size())
+				{
+					sensor_msgs::PointCloud2 cloudMsg;
+					initXYZCloudMsg((newPoints.size()+localMapDeltaDecimation_-1)/localMapDeltaDecimation_, cloudMsg);
+					sensor_msgs::PointCloud2Iterator<float> iterX(cloudMsg, "x");
+					sensor_msgs::PointCloud2Iterator<float> iterY(cloudMsg, "y");
+					sensor_msgs::PointCloud2Iterator<float> iterZ(cloudMsg, "z");
+					for(unsigned int i=0; i<newPoints.size(); i+=localMapDeltaDecimation_, ++iterX, ++iterY, ++iterZ)
+					{
+						*iterX = newPoints[i].x;
+						*iterY = newPoints[i].y;
+						*iterZ = newPoints[i].z;
+					}
+					cloudMsg.header.stamp = stamp; // use corresponding time stamp to image
+					cloudMsg.header.frame_id = odomFrameId_;
+					odomLocalMapDelta_.publish(cloudMsg);
+				}
+			}
+			else
 			{
-				cloud.push_back(iter->second);
+				// a new subscriber will receive the whole map as first delta
+				localMapDelta_.clear();
 			}
-			sensor_msgs::PointCloud2 cloudMsg;
-			pcl::toROSMsg(cloud, cloudMsg);
-			cloudMsg.header.stamp = stamp; // use corresponding time stamp to image
-			cloudMsg.header.frame_id = odomFrameId_;
-			odomLocalMap_.publish(cloudMsg);
 		}
 
 		if(odomLastFrame_.getNumSubscribers())
@@ -452,11 +951,26 @@ void OdometryROS::processData(const SensorData & data, const ros::Time & stamp)
 	{
 		rtabmap_ros::OdomInfo infoMsg;
 		odomInfoToROS(info, infoMsg);
+		infoMsg.timePipeline = timePipeline;
 		infoMsg.header.stamp = stamp; // use corresponding time stamp to image
 		infoMsg.header.frame_id = odomFrameId_;
 		odomInfoPub_.publish(infoMsg);
 	}
 
+	{
+		boost::mutex::scoped_lock lock(statisticsMutex_);
+		ros::WallTime now = ros::WallTime::now();
+		addSample(statsLatency_, (ros::Time::now() - stamp).toSec());
+		addSample(statsTimePipeline_, timePipeline);
+		addSample(statsTimeEstimation_, (timeEstimated - time).toSec());
+		addSample(statsTimePublish_, (now - timeEstimated).toSec());
+		++statsProcessed_;
+		if(pose.isNull())
+		{
+			++statsLost_;
+		}
+	}
+
 	ROS_INFO("Odom: quality=%d, std dev=%fm, update time=%fs", info.inliers, pose.isNull()?0.0f:std::sqrt(info.variance), (ros::WallTime::now()-time).toSec());
 }
 
@@ -465,10 +979,36 @@ bool OdometryROS::isOdometryBOW() const
 	return dynamic_cast<OdometryBOW*>(odometry_) != 0;
 }
 
+// Reset odometry to "pose", the odometry object is kept. With
+// "reset_seed", the last frame received is processed right away: the
+// new local map is ready for the next frame instead of being initialized
+// with it. The caller locks odometryMutex_.
+void OdometryROS::softReset(const Transform & pose)
+{
+	odometry_->reset(pose);
+	resetSkipping();
+	localMap_.clear();
+	localMapDelta_.clear();
+
+	if(resetSeed_ && !lastData_.imageRaw().empty())
+	{
+		rtabmap::OdometryInfo info;
+		Transform seededPose = odometry_->process(lastData_, &info);
+		if(!seededPose.isNull())
+		{
+			ROS_INFO("visual_odometry: local map seeded with the last frame (%d features)", info.features);
+			boost::mutex::scoped_lock lock(lastPoseMutex_);
+			lastPose_ = seededPose;
+			lastVariance_ = info.variance;
+		}
+	}
+}
+
 bool OdometryROS::reset(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
 	ROS_INFO("visual_odometry: reset odom!");
-	odometry_->reset();
+	boost::mutex::scoped_lock lock(odometryMutex_);
+	softReset(Transform::getIdentity());
 	return true;
 }
 
@@ -476,7 +1016,8 @@ bool OdometryROS::resetToPose(rtabmap_ros::ResetPose::Request& req, rtabmap_ros:
 {
 	Transform pose(req.x, req.y, req.z, req.roll, req.pitch, req.yaw);
 	ROS_INFO("visual_odometry: reset odom to pose %s!", pose.prettyPrint().c_str());
-	odometry_->reset(pose);
+	boost::mutex::scoped_lock lock(odometryMutex_);
+	softReset(pose);
 	return true;
 }
 
@@ -0,0 +1,344 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/PosesGridIndex.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+static bool samePose(const rtabmap::Transform & a, const rtabmap::Transform & b)
+{
+	return a.x() == b.x() && a.y() == b.y() && a.z() == b.z() &&
+		   a.r11() == b.r11() && a.r12() == b.r12() && a.r13() == b.r13() &&
+		   a.r21() == b.r21() && a.r22() == b.r22() && a.r23() == b.r23() &&
+		   a.r31() == b.r31() && a.r32() == b.r32() && a.r33() == b.r33();
+}
+
+PosesGridIndex::PosesGridIndex(float cellSize) :
+	cellSize_(cellSize>0.0f?cellSize:1.0f),
+	filteredValid_(false),
+	filteredRadius_(0.0f),
+	filteredAngle_(0.0f)
+{
+}
+
+void PosesGridIndex::clear()
+{
+	poses_.clear();
+	nodeCells_.clear();
+	grid_.clear();
+	filteredValid_ = false;
+	filteredPoses_.clear();
+}
+
+void PosesGridIndex::setCellSize(float cellSize)
+{
+	UASSERT(cellSize > 0.0f);
+	if(cellSize != cellSize_)
+	{
+		cellSize_ = cellSize;
+		// re-hash all poses with the new cell size
+		nodeCells_.clear();
+		grid_.clear();
+		for(std::map<int, rtabmap::Transform>::iterator iter=poses_.begin(); iter!=poses_.end(); ++iter)
+		{
+			insertInGrid(iter->first, iter->second);
+		}
+	}
+}
+
+bool PosesGridIndex::update(const std::map<int, rtabmap::Transform> & poses)
+{
+	bool modified = false;
+
+	// Both maps are sorted by id, they are walked together so that only
+	// new, removed and moved nodes cost more than a pose comparison
+	// (nodes are mostly added at the end of the graph).
+	std::map<int, rtabmap::Transform>::iterator iter = poses_.begin();
+	std::map<int, rtabmap::Transform>::const_iterator jter = poses.begin();
+	while(iter != poses_.end() || jter != poses.end())
+	{
+		if(jter == poses.end() || (iter != poses_.end() && iter->first < jter->first))
+		{
+			// not in the graph anymore
+			removeFromGrid(iter->first);
+			poses_.erase(iter++);
+			modified = true;
+		}
+		else if(iter == poses_.end() || jter->first < iter->first)
+		{
+			// new node, inserted before "iter"
+			poses_.insert(iter, *jter);
+			insertInGrid(jter->first, jter->second);
+			modified = true;
+			++jter;
+		}
+		else
+		{
+			if(!samePose(iter->second, jter->second))
+			{
+				removeFromGrid(iter->first);
+				iter->second = jter->second;
+				insertInGrid(iter->first, iter->second);
+				modified = true;
+			}
+			++iter;
+			++jter;
+		}
+	}
+	if(modified)
+	{
+		filteredValid_ = false;
+	}
+	return modified;
+}
+
+bool PosesGridIndex::update(int id, const rtabmap::Transform & pose)
+{
+	std::map<int, rtabmap::Transform>::iterator iter = poses_.find(id);
+	if(iter != poses_.end())
+	{
+		if(samePose(iter->second, pose))
+		{
+			return false;
+		}
+		removeFromGrid(id);
+		iter->second = pose;
+	}
+	else
+	{
+		poses_.insert(std::make_pair(id, pose));
+	}
+	insertInGrid(id, pose);
+	filteredValid_ = false;
+	return true;
+}
+
+bool PosesGridIndex::remove(int id)
+{
+	if(poses_.erase(id))
+	{
+		removeFromGrid(id);
+		filteredValid_ = false;
+		return true;
+	}
+	return false;
+}
+
+const std::map<int, rtabmap::Transform> & PosesGridIndex::radiusPosesFiltering(float radius, float angle)
+{
+	if(filteredValid_ && radius == filteredRadius_ && angle == filteredAngle_)
+	{
+		return filteredPoses_;
+	}
+
+	filteredRadius_ = radius;
+	filteredAngle_ = angle;
+	filteredValid_ = true;
+
+	if(poses_.size() <= 1 || radius <= 0.0f || angle <= 0.0f)
+	{
+		filteredPoses_ = poses_;
+		return filteredPoses_;
+	}
+
+	if(cellSize_ != radius)
+	{
+		setCellSize(radius);
+	}
+
+	filteredPoses_.clear();
+
+	// Same greedy approach than rtabmap::graph::radiusPosesFiltering(): visiting
+	// nodes by ascending id, all unchecked neighbors with the same orientation
+	// are merged and only the latest one is kept.
+	std::set<int> checked;
+	for(std::map<int, rtabmap::Transform>::iterator iter=poses_.begin(); iter!=poses_.end(); ++iter)
+	{
+		if(iter->second.isNull() || checked.find(iter->first) != checked.end())
+		{
+			continue;
+		}
+
+		std::vector<int> neighbors = radiusSearch(iter->second, radius);
+		Eigen::Vector3f vA = iter->second.toEigen3f().rotation()*Eigen::Vector3f(1,0,0);
+		vA.normalize();
+		int latest = 0;
+		bool found = false;
+		for(unsigned int j=0; j<neighbors.size(); ++j)
+		{
+			if(checked.find(neighbors[j]) == checked.end())
+			{
+				Eigen::Vector3f vB = poses_.at(neighbors[j]).toEigen3f().rotation()*Eigen::Vector3f(1,0,0);
+				vB.normalize();
+				double cosA = vA.dot(vB);
+				cosA = cosA < -1.0?-1.0:cosA > 1.0?1.0:cosA;
+				if(std::acos(cosA) <= angle)
+				{
+					checked.insert(neighbors[j]);
+					latest = neighbors[j]; // ascending ids
+					found = true;
+				}
+			}
+		}
+		if(found)
+		{
+			filteredPoses_.insert(*poses_.find(latest));
+		}
+	}
+	return filteredPoses_;
+}
+
+std::vector<int> PosesGridIndex::radiusSearch(const rtabmap::Transform & center, float radius) const
+{
+	std::vector<int> ids;
+	if(radius <= 0.0f || center.isNull())
+	{
+		return ids;
+	}
+	std::vector<int> candidates;
+	searchCells(center.x()-radius, center.y()-radius, center.z()-radius,
+				center.x()+radius, center.y()+radius, center.z()+radius,
+				candidates);
+	float radiusSqr = radius*radius;
+	for(unsigned int i=0; i<candidates.size(); ++i)
+	{
+		const rtabmap::Transform & p = poses_.at(candidates[i]);
+		float dx = p.x() - center.x();
+		float dy = p.y() - center.y();
+		float dz = p.z() - center.z();
+		if(dx*dx + dy*dy + dz*dz <= radiusSqr)
+		{
+			ids.push_back(candidates[i]);
+		}
+	}
+	return ids;
+}
+
+std::vector<int> PosesGridIndex::boxSearch(
+		float minX, float minY, float minZ,
+		float maxX, float maxY, float maxZ) const
+{
+	std::vector<int> candidates;
+	searchCells(minX, minY, minZ, maxX, maxY, maxZ, candidates);
+	std::vector<int> ids;
+	for(unsigned int i=0; i<candidates.size(); ++i)
+	{
+		const rtabmap::Transform & p = poses_.at(candidates[i]);
+		if(p.x() >= minX && p.x() <= maxX &&
+		   p.y() >= minY && p.y() <= maxY &&
+		   p.z() >= minZ && p.z() <= maxZ)
+		{
+			ids.push_back(candidates[i]);
+		}
+	}
+	return ids;
+}
+
+PosesGridIndex::Cell PosesGridIndex::cellOf(float x, float y, float z) const
+{
+	return Cell(int(std::floor(x/cellSize_)), int(std::floor(y/cellSize_)), int(std::floor(z/cellSize_)));
+}
+
+void PosesGridIndex::insertInGrid(int id, const rtabmap::Transform & pose)
+{
+	if(!pose.isNull())
+	{
+		Cell c = cellOf(pose.x(), pose.y(), pose.z());
+		nodeCells_[id] = c;
+		grid_[c].insert(id);
+	}
+}
+
+void PosesGridIndex::removeFromGrid(int id)
+{
+	std::map<int, Cell>::iterator iter = nodeCells_.find(id);
+	if(iter != nodeCells_.end())
+	{
+		std::map<Cell, std::set<int> >::iterator jter = grid_.find(iter->second);
+		if(jter != grid_.end())
+		{
+			jter->second.erase(id);
+			if(jter->second.empty())
+			{
+				grid_.erase(jter);
+			}
+		}
+		nodeCells_.erase(iter);
+	}
+}
+
+void PosesGridIndex::searchCells(
+		float minX, float minY, float minZ,
+		float maxX, float maxY, float maxZ,
+		std::vector<int> & ids) const
+{
+	if(minX > maxX || minY > maxY || minZ > maxZ || grid_.empty())
+	{
+		return;
+	}
+	Cell minC = cellOf(minX, minY, minZ);
+	Cell maxC = cellOf(maxX, maxY, maxZ);
+	std::set<int> found;
+	if((long long)(maxC.x-minC.x+1)*(maxC.y-minC.y+1)*(maxC.z-minC.z+1) > (long long)grid_.size())
+	{
+		// large query, cheaper to scan the occupied cells
+		for(std::map<Cell, std::set<int> >::const_iterator iter=grid_.begin(); iter!=grid_.end(); ++iter)
+		{
+			const Cell & c = iter->first;
+			if(c.x >= minC.x && c.x <= maxC.x &&
+			   c.y >= minC.y && c.y <= maxC.y &&
+			   c.z >= minC.z && c.z <= maxC.z)
+			{
+				found.insert(iter->second.begin(), iter->second.end());
+			}
+		}
+	}
+	else
+	{
+		for(int x=minC.x; x<=maxC.x; ++x)
+		{
+			for(int y=minC.y; y<=maxC.y; ++y)
+			{
+				for(int z=minC.z; z<=maxC.z; ++z)
+				{
+					std::map<Cell, std::set<int> >::const_iterator iter = grid_.find(Cell(x,y,z));
+					if(iter != grid_.end())
+					{
+						found.insert(iter->second.begin(), iter->second.end());
+					}
+				}
+			}
+		}
+	}
+	ids.insert(ids.end(), found.begin(), found.end());
+}
+
+}
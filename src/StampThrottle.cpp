@@ -0,0 +1,177 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "rtabmap_ros/StampThrottle.h"
+
+#include <ros/console.h>
+#include <algorithm>
+#include <cmath>
+
+#define ODOM_BUFFER_TIME 2.0 // s, odometry poses kept (frames can arrive late)
+#define ODOM_MAX_DELAY 0.5 // s, between a frame and the closest odometry pose
+
+namespace rtabmap_ros {
+
+StampThrottle::StampThrottle() :
+	period_(0.0),
+	linear_(0.0f),
+	angular_(0.0f),
+	lastStamp_(0.0),
+	frameInterval_(0.0),
+	nextBoundary_(-1),
+	firstSelected_(false)
+{
+}
+
+void StampThrottle::setRate(double rate)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	period_ = rate > 0.0?1.0/rate:0.0;
+	nextBoundary_ = -1;
+}
+
+void StampThrottle::setKeyframeMotion(float linear, float angular)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	linear_ = linear;
+	angular_ = angular;
+	lastSelectedPose_.setNull();
+}
+
+void StampThrottle::addOdom(const ros::Time & stamp, const rtabmap::Transform & pose)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	double t = stamp.toSec();
+	if(odoms_.size() && t < odoms_.back().first)
+	{
+		// time jumped back (e.g. a bag restarted)
+		odoms_.clear();
+	}
+	odoms_.push_back(std::make_pair(t, pose));
+	// time-based, whatever the odometry rate
+	while(odoms_.front().first < t - ODOM_BUFFER_TIME)
+	{
+		odoms_.pop_front();
+	}
+}
+
+bool StampThrottle::select(const ros::Time & stamp)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	double t = stamp.toSec();
+	if(lastStamp_ > 0.0 && t < lastStamp_)
+	{
+		ROS_WARN("Frame stamp %f is older than the previous one (%f), throttling is restarted.", t, lastStamp_);
+		reset();
+	}
+	if(lastStamp_ > 0.0 && t > lastStamp_)
+	{
+		frameInterval_ = t - lastStamp_;
+	}
+	lastStamp_ = t;
+
+	bool selected = true;
+	if(period_ > 0.0 && nextBoundary_ >= 0)
+	{
+		// the next frame would be farther from the boundary than this one
+		selected = t + frameInterval_/2.0 >= double(nextBoundary_)*period_;
+	}
+
+	if(selected && isKeyframeMotionEnabled())
+	{
+		rtabmap::Transform pose = poseAt(t);
+		if(pose.isNull())
+		{
+			if(odoms_.empty() && !firstSelected_)
+			{
+				// no odometry yet (e.g. not started), the first frame is published anyway
+				ROS_WARN("No odometry received yet, the first frame is published without keyframe thresholds.");
+			}
+			else
+			{
+				ROS_WARN_THROTTLE(5, "No odometry received at frame stamp %f, frames are not published without odometry when keyframe thresholds are set.", t);
+				selected = false;
+			}
+		}
+		else
+		{
+			if(!lastSelectedPose_.isNull())
+			{
+				float x,y,z,roll,pitch,yaw;
+				(lastSelectedPose_.inverse()*pose).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+				float angle = std::max(std::fabs(roll), std::max(std::fabs(pitch), std::fabs(yaw)));
+				selected = (linear_ > 0.0f && std::sqrt(x*x+y*y+z*z) >= linear_) ||
+						   (angular_ > 0.0f && angle >= angular_);
+			}
+			if(selected)
+			{
+				lastSelectedPose_ = pose;
+			}
+		}
+	}
+
+	firstSelected_ = firstSelected_ || selected;
+	if(selected && period_ > 0.0)
+	{
+		// next boundary after the one this frame is the closest to
+		nextBoundary_ = (long long)std::floor(t/period_ + 0.5) + 1;
+	}
+	return selected;
+}
+
+void StampThrottle::reset()
+{
+	lastStamp_ = 0.0;
+	frameInterval_ = 0.0;
+	nextBoundary_ = -1;
+	lastSelectedPose_.setNull();
+	odoms_.clear();
+	firstSelected_ = false;
+}
+
+rtabmap::Transform StampThrottle::poseAt(double stamp) const
+{
+	rtabmap::Transform pose;
+	double minDelay = ODOM_MAX_DELAY;
+	for(std::deque<std::pair<double, rtabmap::Transform> >::const_reverse_iterator iter=odoms_.rbegin(); iter!=odoms_.rend(); ++iter)
+	{
+		double delay = std::fabs(iter->first - stamp);
+		if(delay <= minDelay)
+		{
+			minDelay = delay;
+			pose = iter->second;
+		}
+		else if(iter->first < stamp)
+		{
+			break; // older poses are farther
+		}
+	}
+	return pose;
+}
+
+}
@@ -38,10 +38,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <image_transport/subscriber_filter.h>
 
 #include <sensor_msgs/CameraInfo.h>
+#include <nav_msgs/Odometry.h>
 
 #include <cv_bridge/cv_bridge.h>
 
-#include <rtabmap/core/util2d.h>
+#include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/ImageDecimation.h"
+#include "rtabmap_ros/StampThrottle.h"
+
+#include <boost/thread/mutex.hpp>
 
 namespace rtabmap_ros
 {
@@ -52,9 +57,12 @@ public:
 	//Constructor
 	DataThrottleNodelet():
 		rate_(0),
+		keyframeLinear_(0),
+		keyframeAngular_(0),
 		approxSync_(0),
 		exactSync_(0),
-		decimation_(1)
+		decimation_(1),
+		subscribed_(false)
 	{
 	}
 
@@ -71,8 +79,10 @@ public:
 	}
 
 private:
-	ros::Time last_update_;
 	double rate_;
+	double keyframeLinear_;
+	double keyframeAngular_;
+	StampThrottle throttle_;
 	virtual void onInit()
 	{
 		ros::NodeHandle& nh = getNodeHandle();
@@ -80,12 +90,8 @@ private:
 
 		ros::NodeHandle rgb_nh(nh, "rgb");
 		ros::NodeHandle depth_nh(nh, "depth");
-		ros::NodeHandle rgb_pnh(private_nh, "rgb");
-		ros::NodeHandle depth_pnh(private_nh, "depth");
 		image_transport::ImageTransport rgb_it(rgb_nh);
 		image_transport::ImageTransport depth_it(depth_nh);
-		image_transport::TransportHints hintsRgb("raw", ros::TransportHints(), rgb_pnh);
-		image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
 
 		int queueSize = 10;
 		bool approxSync = true;
@@ -98,7 +104,15 @@ private:
 		private_nh.param("approx_sync", approxSync, approxSync);
 		private_nh.param("decimation", decimation_, decimation_);
 		ROS_ASSERT(decimation_ >= 1);
+		private_nh.param("keyframe_linear", keyframeLinear_, keyframeLinear_); // m, 0=disabled
+		private_nh.param("keyframe_angular", keyframeAngular_, keyframeAngular_); // rad, 0=disabled
+		throttle_.setRate(rate_);
+		throttle_.setKeyframeMotion(keyframeLinear_, keyframeAngular_);
 		ROS_INFO("Rate=%f Hz", rate_);
+		if(throttle_.isKeyframeMotionEnabled())
+		{
+			ROS_INFO("Keyframes on motion: linear=%f m angular=%f rad", keyframeLinear_, keyframeAngular_);
+		}
 		ROS_INFO("Decimation=%d", decimation_);
 		ROS_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
@@ -113,43 +127,80 @@ private:
 			exactSync_->registerCallback(boost::bind(&DataThrottleNodelet::callback, this, _1, _2, _3));
 		}
 
-		image_sub_.subscribe(rgb_it, rgb_nh.resolveName("image_in"), 1, hintsRgb);
-		image_depth_sub_.subscribe(depth_it, depth_nh.resolveName("image_in"), 1, hintsDepth);
-		info_sub_.subscribe(rgb_nh, "camera_info_in", 1);
-
-		imagePub_ = rgb_it.advertise("image_out", 1);
-		imageDepthPub_ = depth_it.advertise("image_out", 1);
-		infoPub_ = rgb_nh.advertise<sensor_msgs::CameraInfo>("camera_info_out", 1);
+		// Inputs are subscribed only when an output is subscribed
+		boost::mutex::scoped_lock lock(connectMutex_);
+		imagePub_ = rgb_it.advertise("image_out", 1,
+				boost::bind(&DataThrottleNodelet::connectCallback, this),
+				boost::bind(&DataThrottleNodelet::connectCallback, this));
+		imageDepthPub_ = depth_it.advertise("image_out", 1,
+				boost::bind(&DataThrottleNodelet::connectCallback, this),
+				boost::bind(&DataThrottleNodelet::connectCallback, this));
+		infoPub_ = rgb_nh.advertise<sensor_msgs::CameraInfo>("camera_info_out", 1,
+				boost::bind(&DataThrottleNodelet::connectCallback, this),
+				boost::bind(&DataThrottleNodelet::connectCallback, this));
 	};
 
-	void callback(const sensor_msgs::ImageConstPtr& image,
-			const sensor_msgs::ImageConstPtr& imageDepth,
-			const sensor_msgs::CameraInfoConstPtr& camInfo)
+	void connectCallback()
 	{
-		if (rate_ > 0.0)
+		boost::mutex::scoped_lock lock(connectMutex_);
+		bool needed = imagePub_.getNumSubscribers() || imageDepthPub_.getNumSubscribers() || infoPub_.getNumSubscribers();
+		if(!needed && subscribed_)
+		{
+			image_sub_.unsubscribe();
+			image_depth_sub_.unsubscribe();
+			info_sub_.unsubscribe();
+			odomSub_.shutdown();
+			subscribed_ = false;
+		}
+		else if(needed && !subscribed_)
 		{
-			NODELET_DEBUG("update set to %f", rate_);
-			if ( last_update_ + ros::Duration(1.0/rate_) > ros::Time::now())
+			ros::NodeHandle& nh = getNodeHandle();
+			ros::NodeHandle& private_nh = getPrivateNodeHandle();
+
+			ros::NodeHandle rgb_nh(nh, "rgb");
+			ros::NodeHandle depth_nh(nh, "depth");
+			ros::NodeHandle rgb_pnh(private_nh, "rgb");
+			ros::NodeHandle depth_pnh(private_nh, "depth");
+			image_transport::ImageTransport rgb_it(rgb_nh);
+			image_transport::ImageTransport depth_it(depth_nh);
+			image_transport::TransportHints hintsRgb("raw", ros::TransportHints(), rgb_pnh);
+			image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
+
+			image_sub_.subscribe(rgb_it, rgb_nh.resolveName("image_in"), 1, hintsRgb);
+			image_depth_sub_.subscribe(depth_it, depth_nh.resolveName("image_in"), 1, hintsDepth);
+			info_sub_.subscribe(rgb_nh, "camera_info_in", 1);
+			if(throttle_.isKeyframeMotionEnabled())
 			{
-				NODELET_DEBUG("throttle last update at %f skipping", last_update_.toSec());
-				return;
+				odomSub_ = nh.subscribe("odom", 10, &DataThrottleNodelet::odomCallback, this);
 			}
+			subscribed_ = true;
 		}
-		else
-			NODELET_DEBUG("rate unset continuing");
+	}
+
+	void odomCallback(const nav_msgs::OdometryConstPtr & odomMsg)
+	{
+		throttle_.addOdom(odomMsg->header.stamp, transformFromPoseMsg(odomMsg->pose.pose));
+	}
 
-		last_update_ = ros::Time::now();
+	void callback(const sensor_msgs::ImageConstPtr& image,
+			const sensor_msgs::ImageConstPtr& imageDepth,
+			const sensor_msgs::CameraInfoConstPtr& camInfo)
+	{
+		// decided from the stamps, not from the time of reception
+		if(!throttle_.select(image->header.stamp))
+		{
+			NODELET_DEBUG("throttle: frame %f skipped", image->header.stamp.toSec());
+			return;
+		}
 
 		if(imagePub_.getNumSubscribers())
 		{
 			if(decimation_ > 1)
 			{
 				cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(image);
-				cv_bridge::CvImage out;
-				out.header = imagePtr->header;
-				out.encoding = imagePtr->encoding;
-				out.image = rtabmap::util2d::decimate(imagePtr->image, decimation_);
-				imagePub_.publish(out.toImageMsg());
+				cv::Mat out = imageMsgBuffer(imageMsg_, imagePtr->header, imagePtr->image.rows/decimation_, imagePtr->image.cols/decimation_, imagePtr->image.type(), imagePtr->encoding);
+				decimateImage(imagePtr->image, decimation_, false, out);
+				imagePub_.publish(imageMsg_);
 			}
 			else
 			{
@@ -161,11 +212,10 @@ private:
 			if(decimation_ > 1)
 			{
 				cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(imageDepth);
-				cv_bridge::CvImage out;
-				out.header = imagePtr->header;
-				out.encoding = imagePtr->encoding;
-				out.image = rtabmap::util2d::decimate(imagePtr->image, decimation_);
-				imageDepthPub_.publish(out.toImageMsg());
+				cv::Mat out = imageMsgBuffer(imageDepthMsg_, imagePtr->header, imagePtr->image.rows/decimation_, imagePtr->image.cols/decimation_, imagePtr->image.type(), imagePtr->encoding);
+				// valid depths of each block are averaged
+				decimateImage(imagePtr->image, decimation_, imagePtr->image.type() == CV_16UC1 || imagePtr->image.type() == CV_32FC1, out);
+				imageDepthPub_.publish(imageDepthMsg_);
 			}
 			else
 			{
@@ -213,6 +263,14 @@ private:
 
 	int decimation_;
 
+	// decimated images, reused between frames
+	sensor_msgs::ImagePtr imageMsg_;
+	sensor_msgs::ImagePtr imageDepthMsg_;
+
+	ros::Subscriber odomSub_;
+
+	boost::mutex connectMutex_;
+	bool subscribed_;
 };
 
 
@@ -36,10 +36,59 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <image_transport/image_transport.h>
 
 #include <cv_bridge/cv_bridge.h>
+#include <opencv2/core/core.hpp>
+
+#include "rtabmap_ros/MsgConversion.h"
+
+#include <boost/thread/mutex.hpp>
 
 namespace rtabmap_ros
 {
 
+// depth = T*f/disparity for rows of the disparity image, 0 if the disparity
+// is out of ]min, max[. Done with vectorized OpenCV operations on each row
+// range, written directly in the buffers of the output messages.
+class DisparityToDepthBody : public cv::ParallelLoopBody
+{
+public:
+	DisparityToDepthBody(
+			const cv::Mat & disparity,
+			float scale,
+			float minDisparity,
+			float maxDisparity,
+			const cv::Mat & depth32f,
+			const cv::Mat & depth16u) :
+		disparity_(disparity),
+		scale_(scale),
+		minDisparity_(minDisparity),
+		maxDisparity_(maxDisparity),
+		depth32f_(depth32f),
+		depth16u_(depth16u)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		cv::Mat disparity = disparity_.rowRange(range);
+		cv::Mat depth = depth32f_.rowRange(range);
+		cv::divide(scale_, disparity, depth); // 0 where disparity is 0
+		cv::Mat valid = (disparity > minDisparity_) & (disparity < maxDisparity_); // false with NaN
+		depth.setTo(cv::Scalar(0.0f), ~valid);
+		if(!depth16u_.empty())
+		{
+			cv::Mat depth16u = depth16u_.rowRange(range);
+			depth.convertTo(depth16u, CV_16U, 1000.0);
+		}
+	}
+
+private:
+	cv::Mat disparity_;
+	float scale_;
+	float minDisparity_;
+	float maxDisparity_;
+	cv::Mat depth32f_;
+	cv::Mat depth16u_;
+};
+
 class DisparityToDepth : public nodelet::Nodelet
 {
 public:
@@ -53,10 +102,29 @@ private:
 		ros::NodeHandle & nh = getNodeHandle();
 		ros::NodeHandle & pnh = getPrivateNodeHandle();
 
+		// The disparity is subscribed only when a depth image is subscribed
+		boost::mutex::scoped_lock lock(connectMutex_);
 		image_transport::ImageTransport it(nh);
-		pub32f_ = it.advertise("depth", 1);
-		pub16u_ = it.advertise("depth_raw", 1);
-		sub_ = nh.subscribe("disparity", 1, &DisparityToDepth::callback, this);
+		pub32f_ = it.advertise("depth", 1,
+				boost::bind(&DisparityToDepth::connectCallback, this),
+				boost::bind(&DisparityToDepth::connectCallback, this));
+		pub16u_ = it.advertise("depth_raw", 1,
+				boost::bind(&DisparityToDepth::connectCallback, this),
+				boost::bind(&DisparityToDepth::connectCallback, this));
+	}
+
+	void connectCallback()
+	{
+		boost::mutex::scoped_lock lock(connectMutex_);
+		bool needed = pub32f_.getNumSubscribers() || pub16u_.getNumSubscribers();
+		if(!needed && sub_)
+		{
+			sub_.shutdown();
+		}
+		else if(needed && !sub_)
+		{
+			sub_ = getNodeHandle().subscribe("disparity", 1, &DisparityToDepth::callback, this);
+		}
 	}
 
 	void callback(const stereo_msgs::DisparityImageConstPtr& disparityMsg)
@@ -70,70 +138,61 @@ private:
 		bool publish32f = pub32f_.getNumSubscribers();
 		bool publish16u = pub16u_.getNumSubscribers();
 
-		if(publish32f || publish16u)
+		if((publish32f || publish16u) && disparityMsg->image.data.size())
 		{
 			// sensor_msgs::image_encodings::TYPE_32FC1
-			cv::Mat disparity(disparityMsg->image.height, disparityMsg->image.width, CV_32FC1, const_cast<uchar*>(disparityMsg->image.data.data()));
+			cv::Mat disparity(disparityMsg->image.height, disparityMsg->image.width, CV_32FC1, const_cast<uchar*>(disparityMsg->image.data.data()), disparityMsg->image.step);
 
 			cv::Mat depth32f;
 			cv::Mat depth16u;
 			if(publish32f)
 			{
-				depth32f = cv::Mat::zeros(disparity.rows, disparity.cols, CV_32F);
+				depth32f = imageMsgBuffer(depth32fMsg_, disparityMsg->header, disparity.rows, disparity.cols, CV_32FC1, sensor_msgs::image_encodings::TYPE_32FC1);
 			}
-			if(publish16u)
+			else
 			{
-				depth16u = cv::Mat::zeros(disparity.rows, disparity.cols, CV_16U);
+				// only needed for the conversion, kept between frames
+				depth32fBuffer_.create(disparity.rows, disparity.cols, CV_32FC1);
+				depth32f = depth32fBuffer_;
 			}
-			for (int i = 0; i < disparity.rows; i++)
+			if(publish16u)
 			{
-				for (int j = 0; j < disparity.cols; j++)
-				{
-					float disparity_value = disparity.at<float>(i,j);
-					if (disparity_value > disparityMsg->min_disparity && disparity_value < disparityMsg->max_disparity)
-					{
-						// baseline * focal / disparity
-						float depth = disparityMsg->T * disparityMsg->f / disparity_value;
-						if(publish32f)
-						{
-							depth32f.at<float>(i,j) = depth;
-						}
-						if(publish16u)
-						{
-							depth16u.at<unsigned short>(i,j) = (unsigned short)(depth*1000.0f);
-						}
-					}
-				}
+				depth16u = imageMsgBuffer(depth16uMsg_, disparityMsg->header, disparity.rows, disparity.cols, CV_16UC1, sensor_msgs::image_encodings::TYPE_16UC1);
 			}
 
+			// baseline * focal / disparity
+			cv::parallel_for_(
+					cv::Range(0, disparity.rows),
+					DisparityToDepthBody(
+							disparity,
+							disparityMsg->T * disparityMsg->f,
+							disparityMsg->min_disparity,
+							disparityMsg->max_disparity,
+							depth32f,
+							depth16u));
+
 			if(publish32f)
 			{
-				// convert to ROS sensor_msg::Image
-				cv_bridge::CvImage cvDepth(disparityMsg->header, sensor_msgs::image_encodings::TYPE_32FC1, depth32f);
-				sensor_msgs::Image depthMsg;
-				cvDepth.toImageMsg(depthMsg);
-
-				//publish the message
-				pub32f_.publish(depthMsg);
+				pub32f_.publish(depth32fMsg_);
 			}
 
 			if(publish16u)
 			{
-				// convert to ROS sensor_msg::Image
-				cv_bridge::CvImage cvDepth(disparityMsg->header, sensor_msgs::image_encodings::TYPE_16UC1, depth16u);
-				sensor_msgs::Image depthMsg;
-				cvDepth.toImageMsg(depthMsg);
-
-				//publish the message
-				pub16u_.publish(depthMsg);
+				pub16u_.publish(depth16uMsg_);
 			}
 		}
-}
+	}
 
 private:
 	image_transport::Publisher pub32f_;
 	image_transport::Publisher pub16u_;
 	ros::Subscriber sub_;
+	boost::mutex connectMutex_;
+
+	// output buffers reused between frames
+	sensor_msgs::ImagePtr depth32fMsg_;
+	sensor_msgs::ImagePtr depth16uMsg_;
+	cv::Mat depth32fBuffer_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::DisparityToDepth, nodelet::Nodelet);
@@ -31,11 +31,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
+#include <pcl/common/point_tests.h>
 #include <pcl_conversions/pcl_conversions.h>
 
 #include <tf/transform_listener.h>
 
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/bind.hpp>
+
 #include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/CameraInfo.h>
@@ -53,6 +59,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/highgui/highgui.hpp>
 
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/GroundSegmentation.h>
 
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/util3d_filtering.h"
@@ -72,7 +79,16 @@ public:
 		minClusterSize_(20),
 		maxObstaclesHeight_(0.0), // if<=0.0 -> disabled
 		waitForTransform_(false),
-		optimizeForCloseObjects_(false)
+		optimizeForCloseObjects_(false),
+		strategy_("normals"),
+		cellSize_(0.05),
+		maxGroundStep_(0.05),
+		maxGroundHeight_(0.0), // if<=0.0 -> disabled (height_grid: flat elevated surfaces are then ground, unless ground_plane_ransac)
+		groundPlaneRansac_(false),
+		groundTracking_(false),
+		groundTrackingPeriod_(10),
+		groundPlane_(Eigen::Vector4f::Zero()),
+		framesSinceSegmentation_(0)
 	{}
 
 	virtual ~ObstaclesDetection()
@@ -93,14 +109,139 @@ private:
 		pnh.param("max_obstacles_height", maxObstaclesHeight_, maxObstaclesHeight_);
 		pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
 		pnh.param("optimize_for_close_objects", optimizeForCloseObjects_, optimizeForCloseObjects_);
+		pnh.param("segmentation_strategy", strategy_, strategy_);
+		pnh.param("cell_size", cellSize_, cellSize_);
+		pnh.param("max_ground_step", maxGroundStep_, maxGroundStep_);
+		pnh.param("max_ground_height", maxGroundHeight_, maxGroundHeight_);
+		pnh.param("ground_plane_ransac", groundPlaneRansac_, groundPlaneRansac_);
+		pnh.param("ground_tracking", groundTracking_, groundTracking_);
+		pnh.param("ground_tracking_period", groundTrackingPeriod_, groundTrackingPeriod_);
+
+		if(strategy_.compare("normals") != 0 && strategy_.compare("height_grid") != 0)
+		{
+			ROS_ERROR("Unknown segmentation_strategy \"%s\" (\"normals\" or \"height_grid\"), using \"normals\".", strategy_.c_str());
+			strategy_ = "normals";
+		}
+		else if(strategy_.compare("height_grid") == 0 && cellSize_ <= 0.0)
+		{
+			ROS_ERROR("cell_size should be > 0 (%f), set to 0.05.", cellSize_);
+			cellSize_ = 0.05;
+		}
+
+		// The cloud is subscribed only when an output is subscribed
+		boost::mutex::scoped_lock lock(connectMutex_);
+		groundPub_ = nh.advertise<sensor_msgs::PointCloud2>("ground", 1,
+				boost::bind(&ObstaclesDetection::connectCallback, this),
+				boost::bind(&ObstaclesDetection::connectCallback, this));
+		obstaclesPub_ = nh.advertise<sensor_msgs::PointCloud2>("obstacles", 1,
+				boost::bind(&ObstaclesDetection::connectCallback, this),
+				boost::bind(&ObstaclesDetection::connectCallback, this));
+	}
+
+	void connectCallback()
+	{
+		boost::mutex::scoped_lock lock(connectMutex_);
+		bool needed = groundPub_.getNumSubscribers() || obstaclesPub_.getNumSubscribers();
+		if(!needed && cloudSub_)
+		{
+			cloudSub_.shutdown();
+		}
+		else if(needed && !cloudSub_)
+		{
+			cloudSub_ = getNodeHandle().subscribe("cloud", 1, &ObstaclesDetection::callback, this);
+		}
+	}
+
+	// Segment the "indices" points of "cloud", ground and obstacles are
+	// appended with indices of "cloud". Pointers are used to be called in a thread.
+	void segmentFromNormals(
+			const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud,
+			const pcl::IndicesPtr & indices,
+			double normalEstimationRadius,
+			double groundNormalAngle,
+			std::vector<int> * ground,
+			std::vector<int> * obstacles) const
+	{
+		if(indices->empty())
+		{
+			return;
+		}
+		// Indices are ascending: if all points are kept (all valid, no height
+		// limit, no split, no tracked ground), the cloud is used without a copy.
+		pcl::PointCloud<pcl::PointXYZ>::Ptr subCloud = cloud;
+		if(indices->size() != cloud->size())
+		{
+			subCloud.reset(new pcl::PointCloud<pcl::PointXYZ>);
+			pcl::copyPointCloud(*cloud, *indices, *subCloud);
+		}
 
-		cloudSub_ = nh.subscribe("cloud", 1, &ObstaclesDetection::callback, this);
+		pcl::IndicesPtr subGround, subObstacles;
+		rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(
+				subCloud,
+				subGround,
+				subObstacles,
+				normalEstimationRadius,
+				groundNormalAngle,
+				minClusterSize_);
 
-		groundPub_ = nh.advertise<sensor_msgs::PointCloud2>("ground", 1);
-		obstaclesPub_ = nh.advertise<sensor_msgs::PointCloud2>("obstacles", 1);
+		if(subGround.get())
+		{
+			ground->reserve(ground->size() + subGround->size());
+			for(unsigned int i=0; i<subGround->size(); ++i)
+			{
+				ground->push_back(indices->at(subGround->at(i)));
+			}
+		}
+		if(subObstacles.get())
+		{
+			obstacles->reserve(obstacles->size() + subObstacles->size());
+			for(unsigned int i=0; i<subObstacles->size(); ++i)
+			{
+				obstacles->push_back(indices->at(subObstacles->at(i)));
+			}
+		}
 	}
 
+	// Move the points of "indices" on the tracked ground plane in "ground"
+	void removeTrackedGround(
+			const pcl::PointCloud<pcl::PointXYZ> & cloud,
+			std::vector<int> & indices,
+			std::vector<int> & ground) const
+	{
+		int oi = 0;
+		for(unsigned int i=0; i<indices.size(); ++i)
+		{
+			const pcl::PointXYZ & pt = cloud.at(indices[i]);
+			if(std::fabs(groundPlane_.dot(Eigen::Vector4f(pt.x, pt.y, pt.z, 1.0f))) <= maxGroundStep_)
+			{
+				ground.push_back(indices[i]);
+			}
+			else
+			{
+				indices[oi++] = indices[i];
+			}
+		}
+		indices.resize(oi);
+	}
 
+	static void indicesToCloudMsg(
+			const pcl::PointCloud<pcl::PointXYZ> & cloud,
+			const std::vector<int> & indices,
+			sensor_msgs::PointCloud2 & msg)
+	{
+		sensor_msgs::PointCloud2Modifier modifier(msg);
+		modifier.setPointCloud2FieldsByString(1, "xyz");
+		modifier.resize(indices.size());
+		msg.is_dense = true;
+		sensor_msgs::PointCloud2Iterator<float> iterX(msg, "x");
+		for(unsigned int i=0; i<indices.size(); ++i, ++iterX)
+		{
+			const pcl::PointXYZ & pt = cloud.at(indices[i]);
+			iterX[0] = pt.x;
+			iterX[1] = pt.y;
+			iterX[2] = pt.z;
+		}
+	}
 
 	void callback(const sensor_msgs::PointCloud2ConstPtr & cloudMsg)
 	{
@@ -136,107 +277,150 @@ private:
 		pcl::PointCloud<pcl::PointXYZ>::Ptr originalCloud(new pcl::PointCloud<pcl::PointXYZ>);
 		pcl::fromROSMsg(*cloudMsg, *originalCloud);
 
-		//Common variables for all strategies
-		pcl::IndicesPtr ground, obstacles;
-		pcl::PointCloud<pcl::PointXYZ>::Ptr obstaclesCloud(new pcl::PointCloud<pcl::PointXYZ>);
-		pcl::PointCloud<pcl::PointXYZ>::Ptr groundCloud(new pcl::PointCloud<pcl::PointXYZ>);
+		// Indices in originalCloud, for all strategies
+		std::vector<int> ground;
+		std::vector<int> obstacles;
 
 		if(originalCloud->size())
 		{
 			originalCloud = rtabmap::util3d::transformPointCloud(originalCloud, localTransform);
-			if(maxObstaclesHeight_ > 0)
-			{
-				originalCloud = rtabmap::util3d::passThrough(originalCloud, "z", std::numeric_limits<int>::min(), maxObstaclesHeight_);
-			}
 
-			if(originalCloud->size())
+			// Valid points under max_obstacles_height, split at 1 m in x if
+			// optimize_for_close_objects is used, in one pass
+			bool splitNearFar = optimizeForCloseObjects_ && strategy_.compare("normals") == 0;
+			pcl::IndicesPtr nearIndices(new std::vector<int>);
+			pcl::IndicesPtr farIndices(new std::vector<int>);
+			nearIndices->reserve(originalCloud->size());
+			for(unsigned int i=0; i<originalCloud->size(); ++i)
 			{
-				if(!optimizeForCloseObjects_)
+				const pcl::PointXYZ & pt = originalCloud->at(i);
+				if(pcl::isFinite(pt) && (maxObstaclesHeight_ <= 0 || pt.z <= maxObstaclesHeight_))
 				{
-					// This is the default strategy
-					rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(
-							originalCloud,
-							ground,
-							obstacles,
-							normalEstimationRadius_,
-							groundNormalAngle_,
-							minClusterSize_);
-
-					if(groundPub_.getNumSubscribers() && ground.get() && ground->size())
+					if(splitNearFar && pt.x > 1.0f)
 					{
-						pcl::copyPointCloud(*originalCloud, *ground, *groundCloud);
+						farIndices->push_back(i);
 					}
-
-					if(obstaclesPub_.getNumSubscribers() && obstacles.get() && obstacles->size())
+					else
 					{
-						pcl::copyPointCloud(*originalCloud, *obstacles, *obstaclesCloud);
+						nearIndices->push_back(i);
 					}
 				}
-				else
-				{
-					// in this case optimizeForCloseObject_ is true:
-					// we divide the floor point cloud into two subsections, one for all potential floor points up to 1m
-					// one for potential floor points further away than 1m.
-					// For the points at closer range, we use a smaller normal estimation radius and ground normal angle,
-					// which allows to detect smaller objects, without increasing the number of false positive.
-					// For all other points, we use a bigger normal estimation radius (* 3.) and tolerance for the
-					// grond normal angle (* 2.).
-
-					pcl::PointCloud<pcl::PointXYZ>::Ptr originalCloud_near = rtabmap::util3d::passThrough(originalCloud, "x", std::numeric_limits<int>::min(), 1.);
-					pcl::PointCloud<pcl::PointXYZ>::Ptr originalCloud_far = rtabmap::util3d::passThrough(originalCloud, "x", 1., std::numeric_limits<int>::max());
-
-					// Part 1: segment floor and obstacles near the robot
-					rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(
-							originalCloud_near,
-							ground,
-							obstacles,
-							normalEstimationRadius_,
-							groundNormalAngle_,
-							minClusterSize_);
-
-					if(groundPub_.getNumSubscribers() && ground.get() && ground->size())
-					{
-						pcl::copyPointCloud(*originalCloud_near, *ground, *groundCloud);
-						ground->clear();
-					}
-
-					if(obstaclesPub_.getNumSubscribers() && obstacles.get() && obstacles->size())
-					{
-						pcl::copyPointCloud(*originalCloud_near, *obstacles, *obstaclesCloud);
-						obstacles->clear();
-					}
-
-					// Part 2: segment floor and obstacles far from the robot
-					rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(
-							originalCloud_far,
-							ground,
-							obstacles,
-							3.*normalEstimationRadius_,
-							2.*groundNormalAngle_,
-							minClusterSize_);
-
-					if(groundPub_.getNumSubscribers() && ground.get() && ground->size())
-					{
-						pcl::PointCloud<pcl::PointXYZ>::Ptr groundCloud2 (new pcl::PointCloud<pcl::PointXYZ>);
-						pcl::copyPointCloud(*originalCloud_far, *ground, *groundCloud2);
-						*groundCloud += *groundCloud2;
-					}
+			}
 
+			// With ground tracking, points on the ground plane of the previous
+			// full segmentation are ground, only the others are segmented.
+			bool tracked = groundTracking_ &&
+					groundPlane_ != Eigen::Vector4f::Zero() &&
+					framesSinceSegmentation_ < groundTrackingPeriod_;
+			if(tracked)
+			{
+				removeTrackedGround(*originalCloud, *nearIndices, ground);
+				removeTrackedGround(*originalCloud, *farIndices, ground);
+				++framesSinceSegmentation_;
+			}
+			else
+			{
+				framesSinceSegmentation_ = 0;
+			}
+			int trackedGround = (int)ground.size();
 
-					if(obstaclesPub_.getNumSubscribers() && obstacles.get() && obstacles->size())
-					{
-						pcl::PointCloud<pcl::PointXYZ>::Ptr obstacles2(new pcl::PointCloud<pcl::PointXYZ>);
-						pcl::copyPointCloud(*originalCloud_far, *obstacles, *obstacles2);
-						*obstaclesCloud += *obstacles2;
-					}
+			if(strategy_.compare("height_grid") == 0)
+			{
+				// 2.5D grid, no normals to estimate so optimize_for_close_objects is not needed
+				// The tracked plane replaces the RANSAC plane only if it is used:
+				// otherwise the points left after removeTrackedGround() (all off
+				// the plane) are classified by the slope test alone.
+				pcl::IndicesPtr groundIndices, obstaclesIndices;
+				Eigen::Vector4f plane;
+				segmentObstaclesFromHeightGrid(
+						*originalCloud,
+						nearIndices,
+						cellSize_,
+						maxGroundStep_,
+						groundNormalAngle_,
+						maxGroundHeight_,
+						groundPlaneRansac_,
+						minClusterSize_,
+						groundIndices,
+						obstaclesIndices,
+						&plane,
+						tracked && groundPlaneRansac_?&groundPlane_:0,
+						&heightGridBuffers_);
+				ground.insert(ground.end(), groundIndices->begin(), groundIndices->end());
+				obstacles.swap(*obstaclesIndices);
+				if(groundTracking_ && !tracked)
+				{
+					groundPlane_ = plane;
 				}
 			}
+			else if(!splitNearFar)
+			{
+				// This is the default strategy
+				segmentFromNormals(
+						originalCloud,
+						nearIndices,
+						normalEstimationRadius_,
+						groundNormalAngle_,
+						&ground,
+						&obstacles);
+			}
+			else
+			{
+				// in this case optimizeForCloseObject_ is true:
+				// we divide the floor point cloud into two subsections, one for all potential floor points up to 1m
+				// one for potential floor points further away than 1m.
+				// For the points at closer range, we use a smaller normal estimation radius and ground normal angle,
+				// which allows to detect smaller objects, without increasing the number of false positive.
+				// For all other points, we use a bigger normal estimation radius (* 3.) and tolerance for the
+				// grond normal angle (* 2.).
+				// Both subsections are independent, so the far one is segmented in another thread.
+				std::vector<int> farGround;
+				std::vector<int> farObstacles;
+				boost::thread farThread(boost::bind(
+						&ObstaclesDetection::segmentFromNormals,
+						this,
+						originalCloud,
+						farIndices,
+						3.*normalEstimationRadius_,
+						2.*groundNormalAngle_,
+						&farGround,
+						&farObstacles));
+
+				segmentFromNormals(
+						originalCloud,
+						nearIndices,
+						normalEstimationRadius_,
+						groundNormalAngle_,
+						&ground,
+						&obstacles);
+
+				farThread.join();
+				ground.insert(ground.end(), farGround.begin(), farGround.end());
+				obstacles.insert(obstacles.end(), farObstacles.begin(), farObstacles.end());
+			}
+
+			if(groundTracking_ && !tracked && (strategy_.compare("normals") == 0 || !groundPlaneRansac_))
+			{
+				// the model tracked until the next full segmentation
+				groundPlane_ = fitGroundPlane(
+						originalCloud,
+						pcl::IndicesPtr(new std::vector<int>(ground)),
+						groundNormalAngle_,
+						maxGroundStep_);
+			}
+			if(groundTracking_)
+			{
+				ROS_DEBUG("Ground tracking: %d/%d points on the tracked ground (frame %d/%d, plane=%s)",
+						trackedGround, (int)originalCloud->size(), framesSinceSegmentation_, groundTrackingPeriod_,
+						groundPlane_ == Eigen::Vector4f::Zero()?"not found":"found");
+			}
 		}
 
+		// Only the clouds subscribed are created, directly from the indices
 		if(groundPub_.getNumSubscribers())
 		{
 			sensor_msgs::PointCloud2 rosCloud;
-			pcl::toROSMsg(*groundCloud, rosCloud);
+			indicesToCloudMsg(*originalCloud, ground, rosCloud);
 			rosCloud.header.stamp = cloudMsg->header.stamp;
 			rosCloud.header.frame_id = frameId_;
 
@@ -247,7 +431,7 @@ private:
 		if(obstaclesPub_.getNumSubscribers())
 		{
 			sensor_msgs::PointCloud2 rosCloud;
-			pcl::toROSMsg(*obstaclesCloud, rosCloud);
+			indicesToCloudMsg(*originalCloud, obstacles, rosCloud);
 			rosCloud.header.stamp = cloudMsg->header.stamp;
 			rosCloud.header.frame_id = frameId_;
 
@@ -266,6 +450,16 @@ private:
 	double maxObstaclesHeight_;
 	bool waitForTransform_;
 	bool optimizeForCloseObjects_;
+	std::string strategy_; // "normals" or "height_grid"
+	double cellSize_;
+	double maxGroundStep_;
+	double maxGroundHeight_;
+	bool groundPlaneRansac_;
+	bool groundTracking_;
+	int groundTrackingPeriod_; // frames between full segmentations
+	Eigen::Vector4f groundPlane_; // in frame_id, 0 if not tracked
+	int framesSinceSegmentation_;
+	HeightGridBuffers heightGridBuffers_; // reused between clouds
 
 	tf::TransformListener tfListener_;
 
@@ -273,6 +467,7 @@ private:
 	ros::Publisher obstaclesPub_;
 
 	ros::Subscriber cloudSub_;
+	boost::mutex connectMutex_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::ObstaclesDetection, nodelet::Nodelet);
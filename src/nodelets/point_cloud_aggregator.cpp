@@ -2,23 +2,19 @@
 #include <ros/ros.h>
 #include <pluginlib/class_list_macros.h>
 #include <nodelet/nodelet.h>
-
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
+#include <pcl/PCLPointCloud2.h>
+#include <pcl/filters/voxel_grid.h>
 #include <pcl_conversions/pcl_conversions.h>
-
 #include <tf/transform_listener.h>
-
 #include <sensor_msgs/PointCloud2.h>
-
-#include <image_transport/image_transport.h>
-#include <image_transport/subscriber_filter.h>
-
-#include <message_filters/sync_policies/approximate_time.h>
-#include <message_filters/subscriber.h>
-#include <message_filters/sync_policies/approximate_time.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstring>
+#include <cmath>
 
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap/utilite/UConversion.h>
 
 namespace rtabmap_ros
 {
@@ -26,63 +22,380 @@ namespace rtabmap_ros
 class PointCloudAggregator : public nodelet::Nodelet
 {
 public:
-	PointCloudAggregator() : sync(NULL)
+	PointCloudAggregator() :
+		waitForTransform_(false),
+		staticTransforms_(false),
+		voxelSize_(0.0),
+		maxTimeDifference_(0.05)
 	{}
 
 	virtual ~PointCloudAggregator()
+	{}
+
+private:
+	virtual void onInit()
 	{
-	    if (sync!=NULL) delete sync;
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+		int count = 3;
+		int queueSize = 5;
+		pnh.param("count", count, count);
+		pnh.param("queue_size", queueSize, queueSize);
+		pnh.param("frame_id", frameId_, frameId_); // empty: frame of cloud1
+		pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
+		pnh.param("static_transforms", staticTransforms_, staticTransforms_);
+		pnh.param("voxel_size", voxelSize_, voxelSize_);
+		pnh.param("max_time_difference", maxTimeDifference_, maxTimeDifference_); // 0 to disable
+
+		if(count < 1)
+		{
+			ROS_ERROR("count should be >= 1 (%d), set to 1.", count);
+			count = 1;
+		}
+
+		// cloud1, cloud2, ..., cloudN
+		clouds_.resize(count);
+		for(int i=0; i<count; ++i)
+		{
+			std::string topic = "cloud" + uNumber2Str(i+1);
+			cloudSubs_.push_back(nh.subscribe<sensor_msgs::PointCloud2>(topic, queueSize, boost::bind(&PointCloudAggregator::cloudCallback, this, _1, i)));
+		}
+
+		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("combined_cloud", 1);
+
+		ROS_INFO("point_cloud_aggregator: %d inputs, frame_id=\"%s\", voxel_size=%f, max_time_difference=%f", count, frameId_.c_str(), voxelSize_, maxTimeDifference_);
 	}
 
-private:
-	void clouds_callback(const sensor_msgs::PointCloud2ConstPtr & cloudMsg_1,
-	                     const sensor_msgs::PointCloud2ConstPtr & cloudMsg_2,
-	                     const sensor_msgs::PointCloud2ConstPtr & cloudMsg_3)
+	void cloudCallback(const sensor_msgs::PointCloud2ConstPtr & cloudMsg, int index)
 	{
+		std::vector<sensor_msgs::PointCloud2ConstPtr> clouds;
+		{
+			// the inputs can call back from different threads
+			boost::mutex::scoped_lock lock(cloudsMutex_);
+
+			// keep only the latest cloud of each input
+			clouds_[index] = cloudMsg;
+
+			int oldest = 0;
+			ros::Time lowerStamp;
+			ros::Time higherStamp;
+			for(unsigned int i=0; i<clouds_.size(); ++i)
+			{
+				if(!clouds_[i].get())
+				{
+					return; // wait for all inputs
+				}
+				const ros::Time & stamp = clouds_[i]->header.stamp;
+				if(i == 0 || stamp < lowerStamp)
+				{
+					lowerStamp = stamp;
+					oldest = i;
+				}
+				if(i == 0 || stamp > higherStamp)
+				{
+					higherStamp = stamp;
+				}
+			}
+
+			if(maxTimeDifference_ > 0.0 && (higherStamp - lowerStamp).toSec() > maxTimeDifference_)
+			{
+				// The oldest cloud cannot match the next clouds of the
+				// other inputs, drop it and wait for the next one of that input.
+				ROS_DEBUG("Cloud stamps differ by %fs (> max_time_difference=%fs), cloud%d dropped.",
+						(higherStamp - lowerStamp).toSec(), maxTimeDifference_, oldest+1);
+				clouds_[oldest].reset();
+				return;
+			}
+
+			clouds.swap(clouds_);
+			clouds_.resize(clouds.size());
+		}
+
 		if(cloudPub_.getNumSubscribers())
 		{
-			pcl::fromROSMsg(*cloudMsg_1, cloud1);
-			pcl::fromROSMsg(*cloudMsg_2, cloud2);
-			pcl::fromROSMsg(*cloudMsg_3, cloud3);
-		    pcl::PointCloud<pcl::PointXYZ> totalCloud;
-		    totalCloud = cloud1 + cloud2;
-		    totalCloud += cloud3;
-		    sensor_msgs::PointCloud2 rosCloud;
-		    pcl::toROSMsg(totalCloud, rosCloud);
-		    rosCloud.header.stamp = cloudMsg_1->header.stamp;
-		    rosCloud.header.frame_id = cloudMsg_1->header.frame_id;
-		    cloudPub_.publish(rosCloud);
+			aggregate(clouds);
 		}
 	}
 
-    typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::PointCloud2, sensor_msgs::PointCloud2, sensor_msgs::PointCloud2> MySyncPolicy;
-	virtual void onInit()
+	void aggregate(const std::vector<sensor_msgs::PointCloud2ConstPtr> & clouds)
 	{
-		ros::NodeHandle & nh = getNodeHandle();
-		ros::NodeHandle & pnh = getPrivateNodeHandle();
+		const sensor_msgs::PointCloud2 & first = *clouds[0];
+		std::string frameId = frameId_.empty()?first.header.frame_id:frameId_;
 
-		int queueSize = 5;
-		pnh.param("queue_size", queueSize, queueSize);
+		std::vector<rtabmap::Transform> transforms(clouds.size());
+		bool allCompatible = true;
+		size_t totalPoints = 0;
+		for(unsigned int i=0; i<clouds.size(); ++i)
+		{
+			if(fieldOffset(*clouds[i], "x") < 0 || fieldOffset(*clouds[i], "y") < 0 || fieldOffset(*clouds[i], "z") < 0)
+			{
+				ROS_ERROR("cloud%d should have float32 \"x\", \"y\" and \"z\" fields, it is ignored.", i+1);
+				continue;
+			}
+			if(clouds[i]->header.frame_id.compare(frameId) != 0)
+			{
+				transforms[i] = getTransform(clouds[i]->header.frame_id, frameId, clouds[i]->header.stamp);
+				if(transforms[i].isNull())
+				{
+					continue;
+				}
+			}
+			else
+			{
+				transforms[i] = rtabmap::Transform::getIdentity();
+			}
+			allCompatible = allCompatible && compatibleFields(first, *clouds[i]);
+			totalPoints += clouds[i]->width * clouds[i]->height;
+		}
 
-		cloudSub_1_.subscribe(nh, "cloud1", 1);
-		cloudSub_2_.subscribe(nh, "cloud2", 1);
-		cloudSub_3_.subscribe(nh, "cloud3", 1);
+		sensor_msgs::PointCloud2 rosCloud;
+		if(allCompatible)
+		{
+			copyClouds(clouds, transforms, totalPoints, rosCloud);
+		}
+		else
+		{
+			// e.g. a XYZ lidar with a XYZRGB camera
+			ROS_WARN_ONCE("Fields of the input clouds are not all the same, only \"x\", \"y\" and \"z\" are combined.");
+			copyCloudsXYZ(clouds, transforms, totalPoints, rosCloud);
+		}
+		rosCloud.header.stamp = first.header.stamp;
+		rosCloud.header.frame_id = frameId;
 
-        sync = new message_filters::Synchronizer<MySyncPolicy>(MySyncPolicy(queueSize), cloudSub_1_, cloudSub_2_, cloudSub_3_);
-        sync->registerCallback(boost::bind(&rtabmap_ros::PointCloudAggregator::clouds_callback, this, _1, _2, _3));
+		if(voxelSize_ > 0.0)
+		{
+			// works on all fields without conversion to a typed cloud
+			pcl::PCLPointCloud2::Ptr pclCloud(new pcl::PCLPointCloud2);
+			pcl_conversions::toPCL(rosCloud, *pclCloud);
+			pcl::PCLPointCloud2 filtered;
+			pcl::VoxelGrid<pcl::PCLPointCloud2> filter;
+			filter.setLeafSize(voxelSize_, voxelSize_, voxelSize_);
+			filter.setInputCloud(pclCloud);
+			filter.filter(filtered);
+			pcl_conversions::moveFromPCL(filtered, rosCloud);
+		}
 
-		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("combined_cloud", 1);
+		cloudPub_.publish(rosCloud);
+	}
+
+	// Clouds with the same fields: they are copied as is in a preallocated output,
+	// only the points of clouds not already in the target frame are then transformed.
+	static void copyClouds(
+			const std::vector<sensor_msgs::PointCloud2ConstPtr> & clouds,
+			const std::vector<rtabmap::Transform> & transforms,
+			size_t totalPoints,
+			sensor_msgs::PointCloud2 & rosCloud)
+	{
+		const sensor_msgs::PointCloud2 & first = *clouds[0];
+		int xOffset = fieldOffset(first, "x");
+		int yOffset = fieldOffset(first, "y");
+		int zOffset = fieldOffset(first, "z");
+		int nxOffset = fieldOffset(first, "normal_x");
+		int nyOffset = fieldOffset(first, "normal_y");
+		int nzOffset = fieldOffset(first, "normal_z");
+		bool hasNormals = nxOffset >= 0 && nyOffset >= 0 && nzOffset >= 0;
+
+		rosCloud.fields = first.fields;
+		rosCloud.is_bigendian = first.is_bigendian;
+		rosCloud.point_step = first.point_step;
+		rosCloud.height = 1;
+		rosCloud.width = totalPoints;
+		rosCloud.row_step = rosCloud.point_step * rosCloud.width;
+		rosCloud.is_dense = true;
+		rosCloud.data.resize(rosCloud.row_step);
+
+		unsigned char * out = rosCloud.data.data();
+		for(unsigned int i=0; i<clouds.size(); ++i)
+		{
+			if(transforms[i].isNull())
+			{
+				continue;
+			}
+			const sensor_msgs::PointCloud2 & cloud = *clouds[i];
+			size_t rowSize = cloud.width * cloud.point_step;
+			unsigned char * start = out;
+			if(rowSize == cloud.row_step)
+			{
+				memcpy(out, cloud.data.data(), rowSize * cloud.height);
+				out += rowSize * cloud.height;
+			}
+			else
+			{
+				for(unsigned int r=0; r<cloud.height; ++r)
+				{
+					memcpy(out, cloud.data.data() + r*cloud.row_step, rowSize);
+					out += rowSize;
+				}
+			}
+			rosCloud.is_dense = rosCloud.is_dense && cloud.is_dense;
+
+			if(!transforms[i].isIdentity())
+			{
+				Eigen::Affine3f t = transforms[i].toEigen3f();
+				for(unsigned char * p = start; p < out; p += rosCloud.point_step)
+				{
+					float * x = (float*)(p + xOffset);
+					float * y = (float*)(p + yOffset);
+					float * z = (float*)(p + zOffset);
+					Eigen::Vector3f v = t * Eigen::Vector3f(*x, *y, *z);
+					*x = v[0];
+					*y = v[1];
+					*z = v[2];
+					if(hasNormals)
+					{
+						float * nx = (float*)(p + nxOffset);
+						float * ny = (float*)(p + nyOffset);
+						float * nz = (float*)(p + nzOffset);
+						Eigen::Vector3f n = t.linear() * Eigen::Vector3f(*nx, *ny, *nz);
+						*nx = n[0];
+						*ny = n[1];
+						*nz = n[2];
+					}
+				}
+			}
+		}
+	}
+
+	// Clouds with different fields: only the (transformed) x, y and z
+	// of each point are copied in a xyz output.
+	static void copyCloudsXYZ(
+			const std::vector<sensor_msgs::PointCloud2ConstPtr> & clouds,
+			const std::vector<rtabmap::Transform> & transforms,
+			size_t totalPoints,
+			sensor_msgs::PointCloud2 & rosCloud)
+	{
+		sensor_msgs::PointCloud2Modifier modifier(rosCloud);
+		modifier.setPointCloud2FieldsByString(1, "xyz");
+		modifier.resize(totalPoints);
+		rosCloud.is_dense = true;
+
+		sensor_msgs::PointCloud2Iterator<float> iterX(rosCloud, "x");
+		for(unsigned int i=0; i<clouds.size(); ++i)
+		{
+			if(transforms[i].isNull())
+			{
+				continue;
+			}
+			const sensor_msgs::PointCloud2 & cloud = *clouds[i];
+			int xOffset = fieldOffset(cloud, "x");
+			int yOffset = fieldOffset(cloud, "y");
+			int zOffset = fieldOffset(cloud, "z");
+			bool identity = transforms[i].isIdentity();
+			Eigen::Affine3f t = transforms[i].toEigen3f();
+			for(unsigned int r=0; r<cloud.height; ++r)
+			{
+				const unsigned char * row = cloud.data.data() + r*cloud.row_step;
+				for(unsigned int c=0; c<cloud.width; ++c, ++iterX)
+				{
+					const unsigned char * p = row + c*cloud.point_step;
+					Eigen::Vector3f v(*(const float*)(p + xOffset), *(const float*)(p + yOffset), *(const float*)(p + zOffset));
+					if(!identity)
+					{
+						v = t * v;
+					}
+					iterX[0] = v[0];
+					iterX[1] = v[1];
+					iterX[2] = v[2];
+				}
+			}
+			rosCloud.is_dense = rosCloud.is_dense && cloud.is_dense;
+		}
 	}
 
-    message_filters::Synchronizer<MySyncPolicy>* sync;
-	message_filters::Subscriber<sensor_msgs::PointCloud2> cloudSub_1_;
-	message_filters::Subscriber<sensor_msgs::PointCloud2> cloudSub_2_;
-	message_filters::Subscriber<sensor_msgs::PointCloud2> cloudSub_3_;
-	pcl::PointCloud<pcl::PointXYZ> cloud1, cloud2, cloud3;
+	// offset of a float32 field, -1 if not found
+	static int fieldOffset(const sensor_msgs::PointCloud2 & cloud, const std::string & name)
+	{
+		for(unsigned int i=0; i<cloud.fields.size(); ++i)
+		{
+			if(cloud.fields[i].name.compare(name) == 0)
+			{
+				return cloud.fields[i].datatype == sensor_msgs::PointField::FLOAT32?(int)cloud.fields[i].offset:-1;
+			}
+		}
+		return -1;
+	}
+
+	static bool compatibleFields(const sensor_msgs::PointCloud2 & a, const sensor_msgs::PointCloud2 & b)
+	{
+		if(a.point_step != b.point_step || a.is_bigendian != b.is_bigendian || a.fields.size() != b.fields.size())
+		{
+			return false;
+		}
+		for(unsigned int i=0; i<a.fields.size(); ++i)
+		{
+			if(a.fields[i].name.compare(b.fields[i].name) != 0 ||
+			   a.fields[i].offset != b.fields[i].offset ||
+			   a.fields[i].datatype != b.fields[i].datatype ||
+			   a.fields[i].count != b.fields[i].count)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// With static_transforms, the transform of each frame is looked up
+	// only once. Enable it only if all clouds are in frames rigidly
+	// mounted relative to frame_id (e.g. sensors of a rig in the frame
+	// of the robot), not if frame_id is a fixed frame like "odom".
+	rtabmap::Transform getTransform(const std::string & fromFrameId, const std::string & toFrameId, const ros::Time & stamp)
+	{
+		if(staticTransforms_)
+		{
+			boost::mutex::scoped_lock lock(transformsMutex_);
+			std::map<std::string, rtabmap::Transform>::iterator iter = transforms_.find(fromFrameId);
+			if(iter != transforms_.end())
+			{
+				return iter->second;
+			}
+		}
+
+		rtabmap::Transform transform;
+		try
+		{
+			if(waitForTransform_)
+			{
+				if(!tfListener_.waitForTransform(toFrameId, fromFrameId, stamp, ros::Duration(1)))
+				{
+					ROS_WARN("Could not get transform from %s to %s after 1 second!", toFrameId.c_str(), fromFrameId.c_str());
+					return transform;
+				}
+			}
+			tf::StampedTransform tmp;
+			tfListener_.lookupTransform(toFrameId, fromFrameId, stamp, tmp);
+			transform = rtabmap_ros::transformFromTF(tmp);
+		}
+		catch(tf::TransformException & ex)
+		{
+			ROS_WARN("%s",ex.what());
+			return transform;
+		}
+
+		if(staticTransforms_)
+		{
+			boost::mutex::scoped_lock lock(transformsMutex_);
+			transforms_.insert(std::make_pair(fromFrameId, transform));
+		}
+		return transform;
+	}
+
+private:
+	std::string frameId_;
+	bool waitForTransform_;
+	bool staticTransforms_;
+	double voxelSize_;
+	double maxTimeDifference_;
+
+	std::vector<ros::Subscriber> cloudSubs_;
+	std::vector<sensor_msgs::PointCloud2ConstPtr> clouds_;
+	boost::mutex cloudsMutex_;
+	std::map<std::string, rtabmap::Transform> transforms_;
+	boost::mutex transformsMutex_;
+	tf::TransformListener tfListener_;
 
 	ros::Publisher cloudPub_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::PointCloudAggregator, nodelet::Nodelet);
 }
-
@@ -54,6 +54,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/util3d_filtering.h"
 
+#include "rtabmap_ros/DepthToCloud.h"
+
+#include <boost/thread/mutex.hpp>
+
 namespace rtabmap_ros
 {
 
@@ -69,10 +73,12 @@ public:
 		cut_left_(0),
 		cut_right_(0),
 		create_close_obstacle_if_depth_is_missing_(false),
+		parallel_(false),
 		approxSyncDepth_(0),
 		approxSyncDisparity_(0),
 		exactSyncDepth_(0),
-		exactSyncDisparity_(0)
+		exactSyncDisparity_(0),
+		subscribed_(false)
 	{}
 
 	virtual ~PointCloudXYZ()
@@ -105,6 +111,7 @@ private:
 		pnh.param("cut_left", cut_left_, cut_left_);
 		pnh.param("cut_right", cut_right_, cut_right_);
 		pnh.param("special_filter_close_object", create_close_obstacle_if_depth_is_missing_, create_close_obstacle_if_depth_is_missing_);
+		pnh.param("parallel", parallel_, parallel_); // split the depth image rows between threads
 
 		ROS_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
@@ -125,18 +132,41 @@ private:
 			exactSyncDisparity_->registerCallback(boost::bind(&PointCloudXYZ::callbackDisparity, this, _1, _2));
 		}
 
-		ros::NodeHandle depth_nh(nh, "depth");
-		ros::NodeHandle depth_pnh(pnh, "depth");
-		image_transport::ImageTransport depth_it(depth_nh);
-		image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
+		// Inputs are subscribed only when the cloud is subscribed
+		boost::mutex::scoped_lock lock(connectMutex_);
+		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1,
+				boost::bind(&PointCloudXYZ::connectCallback, this),
+				boost::bind(&PointCloudXYZ::connectCallback, this));
+	}
 
-		imageDepthSub_.subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
-		cameraInfoSub_.subscribe(depth_nh, "camera_info", 1);
+	void connectCallback()
+	{
+		boost::mutex::scoped_lock lock(connectMutex_);
+		if(cloudPub_.getNumSubscribers() == 0 && subscribed_)
+		{
+			imageDepthSub_.unsubscribe();
+			cameraInfoSub_.unsubscribe();
+			disparitySub_.unsubscribe();
+			disparityCameraInfoSub_.unsubscribe();
+			subscribed_ = false;
+		}
+		else if(cloudPub_.getNumSubscribers() && !subscribed_)
+		{
+			ros::NodeHandle & nh = getNodeHandle();
+			ros::NodeHandle & pnh = getPrivateNodeHandle();
 
-		disparitySub_.subscribe(nh, "disparity/image", 1);
-		disparityCameraInfoSub_.subscribe(nh, "disparity/camera_info", 1);
+			ros::NodeHandle depth_nh(nh, "depth");
+			ros::NodeHandle depth_pnh(pnh, "depth");
+			image_transport::ImageTransport depth_it(depth_nh);
+			image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
 
-		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1);
+			imageDepthSub_.subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
+			cameraInfoSub_.subscribe(depth_nh, "camera_info", 1);
+
+			disparitySub_.subscribe(nh, "disparity/image", 1);
+			disparityCameraInfoSub_.subscribe(nh, "disparity/camera_info", 1);
+			subscribed_ = true;
+		}
 	}
 
 	void callback(
@@ -155,6 +185,11 @@ private:
 		{
 			cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(depth);
 			cv::Mat image=imageDepthPtr->image;
+			if(cut_left_>0 || cut_right_<0 || create_close_obstacle_if_depth_is_missing_)
+			{
+				// the image is shared with the message, don't modify it
+				image = image.clone();
+			}
 			int rows = image.rows;
 			int cols = image.cols;
 
@@ -188,12 +223,7 @@ private:
 				pRoi = image(cv::Rect(int(cols/10),int(0.8*(float(rows))),int(0.8*(float(cols))),int(0.15*float(rows))));
 				cv::Mat blurredImage=pRoi.clone();
 				cv::GaussianBlur(pRoi, blurredImage, cv::Size(5, 5), 0, 0);
-				for(int y = 0; y < blurredImage.cols; y++)
-					for(int x = 0; x < blurredImage.rows; x++){
-						if (blurredImage.at<unsigned short>(x,y) == 0){
-							pRoi.at<unsigned short>(x,y) = 400;
-						}
-					}
+				pRoi.setTo(image.type()==CV_32FC1?cv::Scalar(0.4):cv::Scalar(400), blurredImage == 0);
 			}
 
 			image_geometry::PinholeCameraModel model;
@@ -203,6 +233,30 @@ private:
 			float cx = model.cx();
 			float cy = model.cy();
 
+			if(noiseFilterRadius_ <= 0.0)
+			{
+				// decimation, max depth and voxel filtering done in one pass
+				sensor_msgs::PointCloud2 rosCloud;
+				rtabmap_ros::depthToCloudMsg(
+						image,
+						cv::Mat(),
+						fx,
+						fy,
+						cx,
+						cy,
+						decimation_,
+						maxDepth_,
+						voxelSize_,
+						parallel_,
+						rosCloud);
+				rosCloud.header.stamp = depth->header.stamp;
+				rosCloud.header.frame_id = depth->header.frame_id;
+
+				//publish the message
+				cloudPub_.publish(rosCloud);
+				return;
+			}
+
 			pcl::PointCloud<pcl::PointXYZ>::Ptr pclCloud;
 			pclCloud = rtabmap::util3d::cloudFromDepth(
 					image,
@@ -295,6 +349,7 @@ private:
 	int cut_left_;
 	int cut_right_;
 	bool create_close_obstacle_if_depth_is_missing_;
+	bool parallel_;
 
 	ros::Publisher cloudPub_;
 
@@ -316,6 +371,9 @@ private:
 	typedef message_filters::sync_policies::ExactTime<stereo_msgs::DisparityImage, sensor_msgs::CameraInfo> MyExactSyncDisparityPolicy;
 	message_filters::Synchronizer<MyExactSyncDisparityPolicy> * exactSyncDisparity_;
 
+	boost::mutex connectMutex_;
+	bool subscribed_;
+
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::PointCloudXYZ, nodelet::Nodelet);
@@ -54,6 +54,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/util3d_filtering.h"
 
+#include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/DepthToCloud.h"
+
+#include <boost/thread/mutex.hpp>
+
 namespace rtabmap_ros
 {
 
@@ -66,10 +71,12 @@ public:
 		decimation_(1),
 		noiseFilterRadius_(0.0),
 		noiseFilterMinNeighbors_(5),
+		parallel_(false),
 		approxSyncDepth_(0),
 		approxSyncStereo_(0),
 		exactSyncDepth_(0),
-		exactSyncStereo_(0)
+		exactSyncStereo_(0),
+		subscribed_(false)
 	{}
 
 	virtual ~PointCloudXYZRGB()
@@ -99,11 +106,10 @@ private:
 		pnh.param("decimation", decimation_, decimation_);
 		pnh.param("noise_filter_radius", noiseFilterRadius_, noiseFilterRadius_);
 		pnh.param("noise_filter_min_neighbors", noiseFilterMinNeighbors_, noiseFilterMinNeighbors_);
+		pnh.param("parallel", parallel_, parallel_); // split the depth image rows between threads
 
 		ROS_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
-		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1);
-
 		if(approxSync)
 		{
 
@@ -122,33 +128,61 @@ private:
 			exactSyncStereo_->registerCallback(boost::bind(&PointCloudXYZRGB::stereoCallback, this, _1, _2, _3, _4));
 		}
 
-		ros::NodeHandle rgb_nh(nh, "rgb");
-		ros::NodeHandle depth_nh(nh, "depth");
-		ros::NodeHandle rgb_pnh(pnh, "rgb");
-		ros::NodeHandle depth_pnh(pnh, "depth");
-		image_transport::ImageTransport rgb_it(rgb_nh);
-		image_transport::ImageTransport depth_it(depth_nh);
-		image_transport::TransportHints hintsRgb("raw", ros::TransportHints(), rgb_pnh);
-		image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
-
-		imageSub_.subscribe(rgb_it, rgb_nh.resolveName("image"), 1, hintsRgb);
-		imageDepthSub_.subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
-		cameraInfoSub_.subscribe(rgb_nh, "camera_info", 1);
-
-
-		ros::NodeHandle left_nh(nh, "left");
-		ros::NodeHandle right_nh(nh, "right");
-		ros::NodeHandle left_pnh(pnh, "left");
-		ros::NodeHandle right_pnh(pnh, "right");
-		image_transport::ImageTransport left_it(left_nh);
-		image_transport::ImageTransport right_it(right_nh);
-		image_transport::TransportHints hintsLeft("raw", ros::TransportHints(), left_pnh);
-		image_transport::TransportHints hintsRight("raw", ros::TransportHints(), right_pnh);
-
-		imageLeft_.subscribe(left_it, left_nh.resolveName("image"), 1, hintsLeft);
-		imageRight_.subscribe(right_it, right_nh.resolveName("image"), 1, hintsRight);
-		cameraInfoLeft_.subscribe(left_nh, "camera_info", 1);
-		cameraInfoRight_.subscribe(right_nh, "camera_info", 1);
+		// Inputs are subscribed only when the cloud is subscribed
+		boost::mutex::scoped_lock lock(connectMutex_);
+		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1,
+				boost::bind(&PointCloudXYZRGB::connectCallback, this),
+				boost::bind(&PointCloudXYZRGB::connectCallback, this));
+	}
+
+	void connectCallback()
+	{
+		boost::mutex::scoped_lock lock(connectMutex_);
+		if(cloudPub_.getNumSubscribers() == 0 && subscribed_)
+		{
+			imageSub_.unsubscribe();
+			imageDepthSub_.unsubscribe();
+			cameraInfoSub_.unsubscribe();
+			imageLeft_.unsubscribe();
+			imageRight_.unsubscribe();
+			cameraInfoLeft_.unsubscribe();
+			cameraInfoRight_.unsubscribe();
+			subscribed_ = false;
+		}
+		else if(cloudPub_.getNumSubscribers() && !subscribed_)
+		{
+			ros::NodeHandle & nh = getNodeHandle();
+			ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+			ros::NodeHandle rgb_nh(nh, "rgb");
+			ros::NodeHandle depth_nh(nh, "depth");
+			ros::NodeHandle rgb_pnh(pnh, "rgb");
+			ros::NodeHandle depth_pnh(pnh, "depth");
+			image_transport::ImageTransport rgb_it(rgb_nh);
+			image_transport::ImageTransport depth_it(depth_nh);
+			image_transport::TransportHints hintsRgb("raw", ros::TransportHints(), rgb_pnh);
+			image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
+
+			imageSub_.subscribe(rgb_it, rgb_nh.resolveName("image"), 1, hintsRgb);
+			imageDepthSub_.subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
+			cameraInfoSub_.subscribe(rgb_nh, "camera_info", 1);
+
+
+			ros::NodeHandle left_nh(nh, "left");
+			ros::NodeHandle right_nh(nh, "right");
+			ros::NodeHandle left_pnh(pnh, "left");
+			ros::NodeHandle right_pnh(pnh, "right");
+			image_transport::ImageTransport left_it(left_nh);
+			image_transport::ImageTransport right_it(right_nh);
+			image_transport::TransportHints hintsLeft("raw", ros::TransportHints(), left_pnh);
+			image_transport::TransportHints hintsRight("raw", ros::TransportHints(), right_pnh);
+
+			imageLeft_.subscribe(left_it, left_nh.resolveName("image"), 1, hintsLeft);
+			imageRight_.subscribe(right_it, right_nh.resolveName("image"), 1, hintsRight);
+			cameraInfoLeft_.subscribe(left_nh, "camera_info", 1);
+			cameraInfoRight_.subscribe(right_nh, "camera_info", 1);
+			subscribed_ = true;
+		}
 	}
 
 	void depthCallback(
@@ -171,9 +205,6 @@ private:
 
 		if(cloudPub_.getNumSubscribers())
 		{
-			cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(image);
-			cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(imageDepth);
-
 			image_geometry::PinholeCameraModel model;
 			model.fromCameraInfo(*cameraInfo);
 			float fx = model.fx();
@@ -181,6 +212,47 @@ private:
 			float cx = model.cx();
 			float cy = model.cy();
 
+			if(noiseFilterRadius_ <= 0.0 &&
+			   image->width == imageDepth->width &&
+			   image->height == imageDepth->height)
+			{
+				// decimation, max depth and voxel filtering done in one pass
+				cv_bridge::CvImageConstPtr imagePtr;
+				if(image->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0 ||
+				   image->encoding.compare(sensor_msgs::image_encodings::RGB8) == 0)
+				{
+					imagePtr = rtabmap_ros::toCvShareCached(image, "bgr8");
+				}
+				else
+				{
+					imagePtr = rtabmap_ros::toCvShareCached(image, image->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0?"":"mono8");
+				}
+				cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(imageDepth);
+
+				sensor_msgs::PointCloud2 rosCloud;
+				rtabmap_ros::depthToCloudMsg(
+						imageDepthPtr->image,
+						imagePtr->image,
+						fx,
+						fy,
+						cx,
+						cy,
+						decimation_,
+						maxDepth_,
+						voxelSize_,
+						parallel_,
+						rosCloud);
+				rosCloud.header.stamp = image->header.stamp;
+				rosCloud.header.frame_id = image->header.frame_id;
+
+				//publish the message
+				cloudPub_.publish(rosCloud);
+				return;
+			}
+
+			cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(image);
+			cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(imageDepth);
+
 			pcl::PointCloud<pcl::PointXYZRGB>::Ptr pclCloud;
 			pclCloud = rtabmap::util3d::cloudFromDepthRGB(
 					imagePtr->image,
@@ -220,13 +292,13 @@ private:
 			if(imageLeft->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 				imageLeft->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
 			{
-				ptrLeftImage = cv_bridge::toCvShare(imageLeft, "mono8");
+				ptrLeftImage = rtabmap_ros::toCvShareCached(imageLeft, "mono8");
 			}
 			else
 			{
-				ptrLeftImage = cv_bridge::toCvShare(imageLeft, "bgr8");
+				ptrLeftImage = rtabmap_ros::toCvShareCached(imageLeft, "bgr8");
 			}
-			ptrRightImage = cv_bridge::toCvShare(imageRight, "mono8");
+			ptrRightImage = rtabmap_ros::toCvShareCached(imageRight, "mono8");
 
 			image_geometry::StereoCameraModel model;
 			model.fromCameraInfo(*camInfoLeft, *camInfoRight);
@@ -286,6 +358,7 @@ private:
 	int decimation_;
 	double noiseFilterRadius_;
 	int noiseFilterMinNeighbors_;
+	bool parallel_;
 
 	ros::Publisher cloudPub_;
 
@@ -309,6 +382,9 @@ private:
 
 	typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> MyExactSyncStereoPolicy;
 	message_filters::Synchronizer<MyExactSyncStereoPolicy> * exactSyncStereo_;
+
+	boost::mutex connectMutex_;
+	bool subscribed_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::PointCloudXYZRGB, nodelet::Nodelet);
@@ -0,0 +1,530 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/OdometryROS.h"
+#include "pluginlib/class_list_macros.h"
+#include "nodelet/nodelet.h"
+
+#include <message_filters/subscriber.h>
+#include <message_filters/time_synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+
+#include <image_transport/image_transport.h>
+#include <image_transport/subscriber_filter.h>
+
+#include <image_geometry/stereo_camera_model.h>
+
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include "rtabmap_ros/MsgConversion.h"
+
+#include <rtabmap/core/util3d.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UConversion.h>
+
+#include <opencv2/core/core.hpp>
+
+#define COMPOSITE_POOL_SIZE 4 // composite images that can be in use at the same time
+
+using namespace rtabmap;
+
+namespace rtabmap_ros
+{
+
+// Copy the images of the cameras side by side in the composite images,
+// each camera is converted in parallel
+class CompositeConversion : public cv::ParallelLoopBody
+{
+public:
+	CompositeConversion(
+			const std::vector<sensor_msgs::ImageConstPtr> & imageMsgs,
+			const std::vector<sensor_msgs::ImageConstPtr> & depthMsgs,
+			const std::string & imageEncoding,
+			const cv::Mat & rgb,
+			const cv::Mat & depth) :
+		imageMsgs_(imageMsgs),
+		depthMsgs_(depthMsgs),
+		imageEncoding_(imageEncoding),
+		rgb_(rgb),
+		depth_(depth)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		for(int i=range.start; i<range.end; ++i)
+		{
+			int width = imageMsgs_[i]->width;
+			int height = imageMsgs_[i]->height;
+			cv::Rect roi(i*width, 0, width, height);
+
+			cv_bridge::CvImageConstPtr ptrImage = rtabmap_ros::toCvShareCached(
+					imageMsgs_[i],
+					imageMsgs_[i]->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0?"":imageEncoding_);
+			ptrImage->image.copyTo(cv::Mat(rgb_, roi));
+
+			cv_bridge::CvImageConstPtr ptrDepth = cv_bridge::toCvShare(depthMsgs_[i]);
+			if(ptrDepth->image.type() == CV_32FC1)
+			{
+				rtabmap::util3d::cvtDepthFromFloat(ptrDepth->image).copyTo(cv::Mat(depth_, roi));
+			}
+			else
+			{
+				ptrDepth->image.copyTo(cv::Mat(depth_, roi));
+			}
+		}
+	}
+
+private:
+	const std::vector<sensor_msgs::ImageConstPtr> & imageMsgs_;
+	const std::vector<sensor_msgs::ImageConstPtr> & depthMsgs_;
+	std::string imageEncoding_;
+	cv::Mat rgb_;
+	cv::Mat depth_;
+};
+
+class RGBDOdometry : public rtabmap_ros::OdometryROS
+{
+public:
+	RGBDOdometry() :
+		rtabmap_ros::OdometryROS(),
+		sync_(0),
+		cameraMaxTimeDifference_(0.02)
+	{
+	}
+
+	virtual ~RGBDOdometry()
+	{
+		if(sync_)
+		{
+			delete sync_;
+		}
+		for(unsigned int i=0; i<cameraSyncs_.size(); ++i)
+		{
+			delete cameraSyncs_[i];
+			delete cameraImageSubs_[i];
+			delete cameraDepthSubs_[i];
+			delete cameraInfoSubs_[i];
+		}
+	}
+
+private:
+	virtual void onOdomInit()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+		int queueSize = 5;
+		int rgbdCameras = 1;
+		pnh.param("queue_size", queueSize, queueSize);
+		if(pnh.getParam("depth_cameras", rgbdCameras))
+		{
+			ROS_WARN("Parameter \"depth_cameras\" has been renamed to \"rgbd_cameras\"! Please update your launch file accordingly.");
+		}
+		pnh.param("rgbd_cameras", rgbdCameras, rgbdCameras);
+		if(rgbdCameras <= 0)
+		{
+			rgbdCameras = 1;
+		}
+
+		if(rgbdCameras >= 2)
+		{
+			// Each camera is synchronized independently, the latest frames
+			// of all cameras are then combined if their stamps are close enough.
+			pnh.param("camera_max_time_difference", cameraMaxTimeDifference_, cameraMaxTimeDifference_);
+			std::string subscribedTopics;
+			for(int i=0; i<rgbdCameras; ++i)
+			{
+				std::string rgbPrefix = uFormat("rgb%d", i);
+				std::string depthPrefix = uFormat("depth%d", i);
+				ros::NodeHandle rgb_nh(nh, rgbPrefix);
+				ros::NodeHandle depth_nh(nh, depthPrefix);
+				ros::NodeHandle rgb_pnh(pnh, rgbPrefix);
+				ros::NodeHandle depth_pnh(pnh, depthPrefix);
+				image_transport::ImageTransport rgb_it(rgb_nh);
+				image_transport::ImageTransport depth_it(depth_nh);
+				image_transport::TransportHints hintsRgb("raw", ros::TransportHints(), rgb_pnh);
+				image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
+
+				cameraImageSubs_.push_back(new image_transport::SubscriberFilter);
+				cameraDepthSubs_.push_back(new image_transport::SubscriberFilter);
+				cameraInfoSubs_.push_back(new message_filters::Subscriber<sensor_msgs::CameraInfo>);
+				cameraImageSubs_.back()->subscribe(rgb_it, rgb_nh.resolveName("image"), 1, hintsRgb);
+				cameraDepthSubs_.back()->subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
+				cameraInfoSubs_.back()->subscribe(rgb_nh, "camera_info", 1);
+
+				cameraSyncs_.push_back(new message_filters::Synchronizer<MySyncPolicy>(
+						MySyncPolicy(queueSize),
+						*cameraImageSubs_.back(),
+						*cameraDepthSubs_.back(),
+						*cameraInfoSubs_.back()));
+				cameraSyncs_.back()->registerCallback(boost::bind(&RGBDOdometry::cameraCallback, this, _1, _2, _3, i));
+				cameraImageSubs_.back()->registerCallback(boost::bind(&RGBDOdometry::countReceived<sensor_msgs::Image>, this, _1));
+
+				subscribedTopics += uFormat("\n   %s,\n   %s,\n   %s",
+						cameraImageSubs_.back()->getTopic().c_str(),
+						cameraDepthSubs_.back()->getTopic().c_str(),
+						cameraInfoSubs_.back()->getTopic().c_str());
+			}
+			cameraImages_.resize(rgbdCameras);
+			cameraDepths_.resize(rgbdCameras);
+			cameraInfos_.resize(rgbdCameras);
+
+			ROS_INFO("\n%s subscribed to (%d cameras):%s",
+					getName().c_str(),
+					rgbdCameras,
+					subscribedTopics.c_str());
+		}
+		else
+		{
+			ros::NodeHandle rgb_nh(nh, "rgb");
+			ros::NodeHandle depth_nh(nh, "depth");
+			ros::NodeHandle rgb_pnh(pnh, "rgb");
+			ros::NodeHandle depth_pnh(pnh, "depth");
+			image_transport::ImageTransport rgb_it(rgb_nh);
+			image_transport::ImageTransport depth_it(depth_nh);
+			image_transport::TransportHints hintsRgb("raw", ros::TransportHints(), rgb_pnh);
+			image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), depth_pnh);
+
+			image_mono_sub_.subscribe(rgb_it, rgb_nh.resolveName("image"), 1, hintsRgb);
+			image_depth_sub_.subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
+			info_sub_.subscribe(rgb_nh, "camera_info", 1);
+
+			ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s",
+					getName().c_str(),
+					image_mono_sub_.getTopic().c_str(),
+					image_depth_sub_.getTopic().c_str(),
+					info_sub_.getTopic().c_str());
+
+			sync_ = new message_filters::Synchronizer<MySyncPolicy>(MySyncPolicy(queueSize), image_mono_sub_, image_depth_sub_, info_sub_);
+			sync_->registerCallback(boost::bind(&RGBDOdometry::callback, this, _1, _2, _3));
+			image_mono_sub_.registerCallback(boost::bind(&RGBDOdometry::countReceived<sensor_msgs::Image>, this, _1));
+		}
+	}
+
+	void callback(
+			const sensor_msgs::ImageConstPtr& image,
+			const sensor_msgs::ImageConstPtr& depth,
+			const sensor_msgs::CameraInfoConstPtr& cameraInfo)
+	{
+		ros::WallTime timeSynchronized = ros::WallTime::now();
+		if(!this->isPaused())
+		{
+			if(!(image->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1) ==0 ||
+				 image->encoding.compare(sensor_msgs::image_encodings::MONO8) ==0 ||
+				 image->encoding.compare(sensor_msgs::image_encodings::MONO16) ==0 ||
+				 image->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0 ||
+				 image->encoding.compare(sensor_msgs::image_encodings::RGB8) == 0) ||
+			   !(depth->encoding.compare(sensor_msgs::image_encodings::TYPE_16UC1)==0 ||
+				 depth->encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1)==0 ||
+				 depth->encoding.compare(sensor_msgs::image_encodings::MONO16)==0))
+			{
+				ROS_ERROR("Input type must be image=mono8,mono16,rgb8,bgr8 (mono8 "
+						  "recommended) and image_depth=16UC1,32FC1,mono16. Types detected: %s %s",
+						image->encoding.c_str(), depth->encoding.c_str());
+				return;
+			}
+			else if(depth->encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1)==0)
+			{
+				static bool warned = false;
+				if(!warned)
+				{
+					ROS_WARN("Input depth type is 32FC1, please use type 16UC1 or mono16 for depth. The depth images "
+							 "will be processed anyway but with a conversion. This warning is only be printed once...");
+					warned = true;
+				}
+			}
+
+			ros::Time stamp = image->header.stamp>depth->header.stamp?image->header.stamp:depth->header.stamp;
+
+			Transform localTransform = this->getLocalTransform(image->header.frame_id, stamp);
+			if(localTransform.isNull())
+			{
+				return;
+			}
+
+			if(image->data.size() && depth->data.size() && cameraInfo->K[4] != 0)
+			{
+				image_geometry::PinholeCameraModel model;
+				model.fromCameraInfo(*cameraInfo);
+				rtabmap::CameraModel rtabmapModel(
+						model.fx(),
+						model.fy(),
+						model.cx(),
+						model.cy(),
+						localTransform);
+				cv_bridge::CvImageConstPtr ptrImage = rtabmap_ros::toCvShareCached(image, image->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0?"":"mono8");
+				cv_bridge::CvImageConstPtr ptrDepth = cv_bridge::toCvShare(depth);
+
+				rtabmap::SensorData data(
+						ptrImage->image,
+						ptrDepth->image,
+						rtabmapModel,
+						0,
+						rtabmap_ros::timestampFromROS(stamp));
+
+				this->processData(data, stamp, timeSynchronized);
+			}
+		}
+	}
+
+	void cameraCallback(
+			const sensor_msgs::ImageConstPtr& image,
+			const sensor_msgs::ImageConstPtr& depth,
+			const sensor_msgs::CameraInfoConstPtr& cameraInfo,
+			int index)
+	{
+		ros::WallTime timeSynchronized = ros::WallTime::now();
+
+		std::vector<sensor_msgs::ImageConstPtr> imageMsgs;
+		std::vector<sensor_msgs::ImageConstPtr> depthMsgs;
+		std::vector<sensor_msgs::CameraInfoConstPtr> infoMsgs;
+		{
+			// the synchronizers of the cameras can call back from different threads
+			boost::mutex::scoped_lock lock(cameraMutex_);
+
+			// keep only the latest frame of each camera
+			cameraImages_[index] = image;
+			cameraDepths_[index] = depth;
+			cameraInfos_[index] = cameraInfo;
+
+			int oldest = 0;
+			ros::Time lowerStamp;
+			ros::Time higherStamp;
+			for(unsigned int i=0; i<cameraImages_.size(); ++i)
+			{
+				if(!cameraImages_[i].get())
+				{
+					return; // wait for all cameras
+				}
+				const ros::Time & stamp = cameraImages_[i]->header.stamp;
+				if(i == 0 || stamp < lowerStamp)
+				{
+					lowerStamp = stamp;
+					oldest = i;
+				}
+				if(i == 0 || stamp > higherStamp)
+				{
+					higherStamp = stamp;
+				}
+			}
+
+			if(cameraMaxTimeDifference_ > 0.0 && (higherStamp - lowerStamp).toSec() > cameraMaxTimeDifference_)
+			{
+				// The oldest frame cannot match the next frames of the other
+				// cameras, drop it and wait for the next frame of that camera.
+				ROS_DEBUG("Camera stamps differ by %fs (> camera_max_time_difference=%fs), frame of camera %d dropped.",
+						(higherStamp - lowerStamp).toSec(), cameraMaxTimeDifference_, oldest);
+				cameraImages_[oldest].reset();
+				cameraDepths_[oldest].reset();
+				cameraInfos_[oldest].reset();
+				return;
+			}
+
+			imageMsgs.swap(cameraImages_);
+			depthMsgs.swap(cameraDepths_);
+			infoMsgs.swap(cameraInfos_);
+			cameraImages_.resize(imageMsgs.size());
+			cameraDepths_.resize(depthMsgs.size());
+			cameraInfos_.resize(infoMsgs.size());
+		}
+
+		if(!this->isPaused())
+		{
+			processCameras(imageMsgs, depthMsgs, infoMsgs, timeSynchronized);
+		}
+	}
+
+	void processCameras(
+			const std::vector<sensor_msgs::ImageConstPtr> & imageMsgs,
+			const std::vector<sensor_msgs::ImageConstPtr> & depthMsgs,
+			const std::vector<sensor_msgs::CameraInfoConstPtr> & infoMsgs,
+			const ros::WallTime & timeSynchronized)
+	{
+		ros::Time higherStamp;
+		int imageWidth = imageMsgs[0]->width;
+		int imageHeight = imageMsgs[0]->height;
+		int cameraCount = imageMsgs.size();
+		std::string imageEncoding;
+		std::vector<CameraModel> cameraModels;
+		for(unsigned int i=0; i<imageMsgs.size(); ++i)
+		{
+			if(!(imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1) ==0 ||
+				 imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO8) ==0 ||
+				 imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO16) ==0 ||
+				 imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0 ||
+				 imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::RGB8) == 0) ||
+				!(depthMsgs[i]->encoding.compare(sensor_msgs::image_encodings::TYPE_16UC1) == 0 ||
+				 depthMsgs[i]->encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1) == 0 ||
+				 depthMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0))
+			{
+				ROS_ERROR("Input type must be image=mono8,mono16,rgb8,bgr8 and image_depth=32FC1,16UC1,mono16");
+				return;
+			}
+			UASSERT(imageMsgs[i]->width == imageWidth && imageMsgs[i]->height == imageHeight);
+			UASSERT(depthMsgs[i]->width == imageWidth && depthMsgs[i]->height == imageHeight);
+
+			std::string encoding;
+			if(imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
+			   imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
+			   imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
+			{
+				encoding = "mono8";
+			}
+			else
+			{
+				encoding = "bgr8";
+			}
+			if(i == 0)
+			{
+				imageEncoding = encoding;
+			}
+			else if(encoding.compare(imageEncoding) != 0)
+			{
+				ROS_ERROR("Some RGB images are not the same type!");
+				return;
+			}
+
+			if(depthMsgs[i]->encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1) == 0)
+			{
+				static bool shown = false;
+				if(!shown)
+				{
+					ROS_WARN("Use depth image with \"unsigned short\" type to "
+							 "avoid conversion. This message is only printed once...");
+					shown = true;
+				}
+			}
+
+			ros::Time stamp = imageMsgs[i]->header.stamp>depthMsgs[i]->header.stamp?imageMsgs[i]->header.stamp:depthMsgs[i]->header.stamp;
+
+			if(i == 0)
+			{
+				higherStamp = stamp;
+			}
+			else if(stamp > higherStamp)
+			{
+				higherStamp = stamp;
+			}
+
+			Transform localTransform = this->getLocalTransform(imageMsgs[i]->header.frame_id, stamp);
+			if(localTransform.isNull())
+			{
+				return;
+			}
+
+			image_geometry::PinholeCameraModel model;
+			model.fromCameraInfo(*infoMsgs[i]);
+			cameraModels.push_back(rtabmap::CameraModel(
+					model.fx(),
+					model.fy(),
+					model.cx(),
+					model.cy(),
+					localTransform));
+		}
+
+		cv::Mat rgb;
+		cv::Mat depth;
+		{
+			// a buffer returned is referenced, it cannot be taken by another thread
+			boost::mutex::scoped_lock lock(cameraMutex_);
+			rgb = compositeBuffer(rgbPool_, imageHeight, imageWidth*cameraCount, imageEncoding.compare("mono8")==0?CV_8UC1:CV_8UC3);
+			depth = compositeBuffer(depthPool_, imageHeight, imageWidth*cameraCount, CV_16UC1);
+		}
+		cv::parallel_for_(cv::Range(0, cameraCount), CompositeConversion(imageMsgs, depthMsgs, imageEncoding, rgb, depth));
+
+		rtabmap::SensorData data(
+				rgb,
+				depth,
+				cameraModels,
+				0,
+				rtabmap_ros::timestampFromROS(higherStamp));
+
+		this->processData(data, higherStamp, timeSynchronized);
+	}
+
+	// Return a composite image of the pool not used anymore by odometry
+	// (only referenced by the pool), or a new one if they are all in use.
+	static cv::Mat compositeBuffer(std::vector<cv::Mat> & pool, int rows, int cols, int type)
+	{
+		for(unsigned int i=0; i<pool.size(); ++i)
+		{
+#if CV_MAJOR_VERSION > 2
+			int refs = pool[i].u?pool[i].u->refcount:0;
+#else
+			int refs = pool[i].refcount?*pool[i].refcount:0;
+#endif
+			if(refs == 1 && pool[i].rows == rows && pool[i].cols == cols && pool[i].type() == type)
+			{
+				return pool[i];
+			}
+		}
+		cv::Mat buffer(rows, cols, type);
+		if(pool.size() < COMPOSITE_POOL_SIZE)
+		{
+			pool.push_back(buffer);
+		}
+		else
+		{
+			// replace a buffer of another size/type, if any
+			for(unsigned int i=0; i<pool.size(); ++i)
+			{
+				if(pool[i].rows != rows || pool[i].cols != cols || pool[i].type() != type)
+				{
+					pool[i] = buffer;
+					break;
+				}
+			}
+		}
+		return buffer;
+	}
+
+private:
+	image_transport::SubscriberFilter image_mono_sub_;
+	image_transport::SubscriberFilter image_depth_sub_;
+	message_filters::Subscriber<sensor_msgs::CameraInfo> info_sub_;
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo> MySyncPolicy;
+	message_filters::Synchronizer<MySyncPolicy> * sync_;
+
+	// rgbd_cameras >= 2
+	std::vector<image_transport::SubscriberFilter*> cameraImageSubs_;
+	std::vector<image_transport::SubscriberFilter*> cameraDepthSubs_;
+	std::vector<message_filters::Subscriber<sensor_msgs::CameraInfo>*> cameraInfoSubs_;
+	std::vector<message_filters::Synchronizer<MySyncPolicy>*> cameraSyncs_;
+	std::vector<sensor_msgs::ImageConstPtr> cameraImages_;
+	std::vector<sensor_msgs::ImageConstPtr> cameraDepths_;
+	std::vector<sensor_msgs::CameraInfoConstPtr> cameraInfos_;
+	boost::mutex cameraMutex_;
+	double cameraMaxTimeDifference_;
+	std::vector<cv::Mat> rgbPool_;
+	std::vector<cv::Mat> depthPool_;
+};
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::RGBDOdometry, nodelet::Nodelet);
+
+}
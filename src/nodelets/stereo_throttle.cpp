@@ -37,10 +37,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <image_transport/subscriber_filter.h>
 
 #include <sensor_msgs/CameraInfo.h>
+#include <nav_msgs/Odometry.h>
 
 #include <cv_bridge/cv_bridge.h>
 
-#include <rtabmap/core/util2d.h>
+#include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/ImageDecimation.h"
+#include "rtabmap_ros/StampThrottle.h"
+
+#include <boost/thread/mutex.hpp>
 
 namespace rtabmap_ros
 {
@@ -51,9 +56,12 @@ public:
 	//Constructor
 	StereoThrottleNodelet():
 		rate_(0),
+		keyframeLinear_(0),
+		keyframeAngular_(0),
 		approxSync_(0),
 		exactSync_(0),
-		decimation_(1)
+		decimation_(1),
+		subscribed_(false)
 	{
 	}
 
@@ -70,8 +78,10 @@ public:
 	}
 
 private:
-	ros::Time last_update_;
 	double rate_;
+	double keyframeLinear_;
+	double keyframeAngular_;
+	StampThrottle throttle_;
 	virtual void onInit()
 	{
 		ros::NodeHandle& nh = getNodeHandle();
@@ -79,12 +89,8 @@ private:
 
 		ros::NodeHandle left_nh(nh, "left");
 		ros::NodeHandle right_nh(nh, "right");
-		ros::NodeHandle left_pnh(pnh, "left");
-		ros::NodeHandle right_pnh(pnh, "right");
 		image_transport::ImageTransport left_it(left_nh);
 		image_transport::ImageTransport right_it(right_nh);
-		image_transport::TransportHints hintsLeft("raw", ros::TransportHints(), left_pnh);
-		image_transport::TransportHints hintsRight("raw", ros::TransportHints(), right_pnh);
 
 		int queueSize = 5;
 		bool approxSync = false;
@@ -93,7 +99,15 @@ private:
 		pnh.param("queue_size", queueSize, queueSize);
 		pnh.param("decimation", decimation_, decimation_);
 		ROS_ASSERT(decimation_ >= 1);
+		pnh.param("keyframe_linear", keyframeLinear_, keyframeLinear_); // m, 0=disabled
+		pnh.param("keyframe_angular", keyframeAngular_, keyframeAngular_); // rad, 0=disabled
+		throttle_.setRate(rate_);
+		throttle_.setKeyframeMotion(keyframeLinear_, keyframeAngular_);
 		ROS_INFO("Rate=%f Hz", rate_);
+		if(throttle_.isKeyframeMotionEnabled())
+		{
+			ROS_INFO("Keyframes on motion: linear=%f m angular=%f rad", keyframeLinear_, keyframeAngular_);
+		}
 		ROS_INFO("Decimation=%d", decimation_);
 		ROS_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
@@ -108,46 +122,89 @@ private:
 			exactSync_->registerCallback(boost::bind(&StereoThrottleNodelet::callback, this, _1, _2, _3, _4));
 		}
 
-		imageLeft_.subscribe(left_it, left_nh.resolveName("image"), 1, hintsLeft);
-		imageRight_.subscribe(right_it, right_nh.resolveName("image"), 1, hintsRight);
-		cameraInfoLeft_.subscribe(left_nh, "camera_info", 1);
-		cameraInfoRight_.subscribe(right_nh, "camera_info", 1);
-
-		imageLeftPub_ = left_it.advertise(left_nh.resolveName("image")+"_throttle", 1);
-		imageRightPub_ = right_it.advertise(right_nh.resolveName("image")+"_throttle", 1);
-		infoLeftPub_ = left_nh.advertise<sensor_msgs::CameraInfo>(left_nh.resolveName("camera_info")+"_throttle", 1);
-		infoRightPub_ = right_nh.advertise<sensor_msgs::CameraInfo>(right_nh.resolveName("camera_info")+"_throttle", 1);
+		// Inputs are subscribed only when an output is subscribed
+		boost::mutex::scoped_lock lock(connectMutex_);
+		imageLeftPub_ = left_it.advertise(left_nh.resolveName("image")+"_throttle", 1,
+				boost::bind(&StereoThrottleNodelet::connectCallback, this),
+				boost::bind(&StereoThrottleNodelet::connectCallback, this));
+		imageRightPub_ = right_it.advertise(right_nh.resolveName("image")+"_throttle", 1,
+				boost::bind(&StereoThrottleNodelet::connectCallback, this),
+				boost::bind(&StereoThrottleNodelet::connectCallback, this));
+		infoLeftPub_ = left_nh.advertise<sensor_msgs::CameraInfo>(left_nh.resolveName("camera_info")+"_throttle", 1,
+				boost::bind(&StereoThrottleNodelet::connectCallback, this),
+				boost::bind(&StereoThrottleNodelet::connectCallback, this));
+		infoRightPub_ = right_nh.advertise<sensor_msgs::CameraInfo>(right_nh.resolveName("camera_info")+"_throttle", 1,
+				boost::bind(&StereoThrottleNodelet::connectCallback, this),
+				boost::bind(&StereoThrottleNodelet::connectCallback, this));
 	};
 
+	void connectCallback()
+	{
+		boost::mutex::scoped_lock lock(connectMutex_);
+		bool needed = imageLeftPub_.getNumSubscribers() ||
+				imageRightPub_.getNumSubscribers() ||
+				infoLeftPub_.getNumSubscribers() ||
+				infoRightPub_.getNumSubscribers();
+		if(!needed && subscribed_)
+		{
+			imageLeft_.unsubscribe();
+			imageRight_.unsubscribe();
+			cameraInfoLeft_.unsubscribe();
+			cameraInfoRight_.unsubscribe();
+			odomSub_.shutdown();
+			subscribed_ = false;
+		}
+		else if(needed && !subscribed_)
+		{
+			ros::NodeHandle& nh = getNodeHandle();
+			ros::NodeHandle& pnh = getPrivateNodeHandle();
+
+			ros::NodeHandle left_nh(nh, "left");
+			ros::NodeHandle right_nh(nh, "right");
+			ros::NodeHandle left_pnh(pnh, "left");
+			ros::NodeHandle right_pnh(pnh, "right");
+			image_transport::ImageTransport left_it(left_nh);
+			image_transport::ImageTransport right_it(right_nh);
+			image_transport::TransportHints hintsLeft("raw", ros::TransportHints(), left_pnh);
+			image_transport::TransportHints hintsRight("raw", ros::TransportHints(), right_pnh);
+
+			imageLeft_.subscribe(left_it, left_nh.resolveName("image"), 1, hintsLeft);
+			imageRight_.subscribe(right_it, right_nh.resolveName("image"), 1, hintsRight);
+			cameraInfoLeft_.subscribe(left_nh, "camera_info", 1);
+			cameraInfoRight_.subscribe(right_nh, "camera_info", 1);
+			if(throttle_.isKeyframeMotionEnabled())
+			{
+				odomSub_ = nh.subscribe("odom", 10, &StereoThrottleNodelet::odomCallback, this);
+			}
+			subscribed_ = true;
+		}
+	}
+
+	void odomCallback(const nav_msgs::OdometryConstPtr & odomMsg)
+	{
+		throttle_.addOdom(odomMsg->header.stamp, transformFromPoseMsg(odomMsg->pose.pose));
+	}
+
 	void callback(const sensor_msgs::ImageConstPtr& imageLeft,
 			const sensor_msgs::ImageConstPtr& imageRight,
 			const sensor_msgs::CameraInfoConstPtr& camInfoLeft,
 			const sensor_msgs::CameraInfoConstPtr& camInfoRight)
 	{
-		if (rate_ > 0.0)
+		// decided from the stamps, not from the time of reception
+		if(!throttle_.select(imageLeft->header.stamp))
 		{
-			NODELET_DEBUG("update set to %f", rate_);
-			if ( last_update_ + ros::Duration(1.0/rate_) > ros::Time::now())
-			{
-				NODELET_DEBUG("throttle last update at %f skipping", last_update_.toSec());
-				return;
-			}
+			NODELET_DEBUG("throttle: frame %f skipped", imageLeft->header.stamp.toSec());
+			return;
 		}
-		else
-			NODELET_DEBUG("rate unset continuing");
-
-		last_update_ = ros::Time::now();
 
 		if(imageLeftPub_.getNumSubscribers())
 		{
 			if(decimation_ > 1)
 			{
 				cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(imageLeft);
-				cv_bridge::CvImage out;
-				out.header = imagePtr->header;
-				out.encoding = imagePtr->encoding;
-				out.image = rtabmap::util2d::decimate(imagePtr->image, decimation_);
-				imageLeftPub_.publish(out.toImageMsg());
+				cv::Mat out = imageMsgBuffer(imageLeftMsg_, imagePtr->header, imagePtr->image.rows/decimation_, imagePtr->image.cols/decimation_, imagePtr->image.type(), imagePtr->encoding);
+				decimateImage(imagePtr->image, decimation_, false, out);
+				imageLeftPub_.publish(imageLeftMsg_);
 			}
 			else
 			{
@@ -159,11 +216,9 @@ private:
 			if(decimation_ > 1)
 			{
 				cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(imageRight);
-				cv_bridge::CvImage out;
-				out.header = imagePtr->header;
-				out.encoding = imagePtr->encoding;
-				out.image = rtabmap::util2d::decimate(imagePtr->image, decimation_);
-				imageRightPub_.publish(out.toImageMsg());
+				cv::Mat out = imageMsgBuffer(imageRightMsg_, imagePtr->header, imagePtr->image.rows/decimation_, imagePtr->image.cols/decimation_, imagePtr->image.type(), imagePtr->encoding);
+				decimateImage(imagePtr->image, decimation_, false, out);
+				imageRightPub_.publish(imageRightMsg_);
 			}
 			else
 			{
@@ -239,6 +294,14 @@ private:
 
 	int decimation_;
 
+	// decimated images, reused between frames
+	sensor_msgs::ImagePtr imageLeftMsg_;
+	sensor_msgs::ImagePtr imageRightMsg_;
+
+	ros::Subscriber odomSub_;
+
+	boost::mutex connectMutex_;
+	bool subscribed_;
 };
 
 
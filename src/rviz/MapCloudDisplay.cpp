@@ -304,15 +304,15 @@ void MapCloudDisplay::processMapData(const rtabmap_ros::MapData& map)
 		poses.insert(std::make_pair(map.posesId[i], rtabmap_ros::transformFromPoseMsg(map.poses[i])));
 	}
 
-	if(node_filtering_angle_->getFloat() > 0.0f && node_filtering_radius_->getFloat() > 0.0f)
-	{
-		poses = rtabmap::graph::radiusPosesFiltering(poses,
-				node_filtering_radius_->getFloat(),
-				node_filtering_angle_->getFloat()*CV_PI/180.0);
-	}
-
 	{
 		boost::mutex::scoped_lock lock(current_map_mutex_);
+		if(node_filtering_angle_->getFloat() > 0.0f && node_filtering_radius_->getFloat() > 0.0f)
+		{
+			posesIndex_.update(poses);
+			poses = posesIndex_.radiusPosesFiltering(
+					node_filtering_radius_->getFloat(),
+					node_filtering_angle_->getFloat()*CV_PI/180.0);
+		}
 		current_map_ = poses;
 	}
 }
@@ -706,6 +706,7 @@ void MapCloudDisplay::reset()
 	{
 		boost::mutex::scoped_lock lock(current_map_mutex_);
 		current_map_.clear();
+		posesIndex_.clear();
 	}
 }
 
@@ -33,6 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include <rtabmap_ros/MapData.h>
+#include <rtabmap_ros/PosesGridIndex.h>
 #include <rtabmap/core/Transform.h>
 
 #include <pluginlib/class_loader.h>
@@ -163,6 +164,7 @@ private:
 	boost::mutex new_clouds_mutex_;
 
 	std::map<int, rtabmap::Transform> current_map_;
+	PosesGridIndex posesIndex_;
 	boost::mutex current_map_mutex_;
 
 	struct TransformerInfo